@@ -0,0 +1,358 @@
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <openssl/evp.h>
+#include <zlib.h>
+
+#include "compression.h"
+#include "cpu.h"
+#include "crypto/kdf/fastpbkdf2.h"
+#include "crypto/mode/aead.h"
+#include "crypto/mode/ctr.h"
+#include "crypto/mode/ecb.h"
+#include "crypto/rc6.h"
+#include "dna64.h"
+
+#ifdef ENV_X86
+#include <x86intrin.h>
+#endif
+
+/**
+ * Throughput benchmarks of the hot paths, not part of the default build: make dnahide_bench
+ * Usage: dnahide_bench [case ...], every case runs when none is named
+ */
+
+using namespace std;
+
+/// Seconds each measurement runs for at least
+static const double MIN_SECONDS = 0.5;
+
+static vector<u8> random_bytes(size_t len)
+{
+    mt19937 rng(1);
+    vector<u8> bytes(len);
+    for (u8& b : bytes)
+        b = (u8) rng();
+    return bytes;
+}
+
+/// Time stamp counter, cycles at the nominal clock, or 0 where there is none
+static u64 cycles()
+{
+#ifdef ENV_X86
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/// Calls of a measured body, and the seconds and cycles they took
+struct Timing {
+    size_t calls;
+    double seconds;
+    u64 cycles;
+};
+
+/**
+ * Run body once to warm up, then until MIN_SECONDS have passed
+ * @param body: work to measure
+ */
+static Timing time_calls(const function<void()>& body)
+{
+    using clock = chrono::steady_clock;
+    body();
+
+    Timing timing{0, 0, cycles()};
+    const clock::time_point start = clock::now();
+    do {
+        body();
+        timing.calls++;
+        timing.seconds = chrono::duration<double>(clock::now() - start).count();
+    } while (timing.seconds < MIN_SECONDS);
+    timing.cycles = cycles() - timing.cycles;
+    return timing;
+}
+
+/**
+ * Measure body and print its throughput and cycles per byte
+ * @param label: what is measured
+ * @param bytes: bytes processed per call of body
+ * @param body: work to measure
+ * @return MB/s
+ */
+static double measure(const string& label, size_t bytes, const function<void()>& body)
+{
+    const Timing timing = time_calls(body);
+    const double mb_per_s = (double) bytes * timing.calls / timing.seconds / 1e6;
+    const double cycles_per_byte = (double) timing.cycles / ((double) bytes * timing.calls);
+    cout << "  " << left << setw(44) << label << right << fixed << setprecision(1) << setw(10) << mb_per_s
+         << " MB/s" << setw(8) << cycles_per_byte << " cycles/byte\n";
+    return mb_per_s;
+}
+
+/**
+ * Measure body and print how many times per second it runs
+ * @param label: what is measured
+ * @param unit: what one call of body produces
+ * @param body: work to measure
+ * @return calls per second
+ */
+static double measure_rate(const string& label, const string& unit, const function<void()>& body)
+{
+    const Timing timing = time_calls(body);
+    const double per_s = timing.calls / timing.seconds;
+    cout << "  " << left << setw(44) << label << right << fixed << setprecision(1) << setw(10) << per_s << " "
+         << unit << "/s\n";
+    return per_s;
+}
+
+/**
+ * RC6-128 per block with the key schedule run on every call, as before keyed ciphers, and keyed once
+ * One block per call runs the unrolled scalar rounds, whole buffers take the 8-block AVX2 path where present
+ */
+static void bench_rc6()
+{
+    const vector<u8> key = random_bytes(16);
+    vector<u8> block = random_bytes(16);
+    const size_t blocks = 4096;
+
+    RC6<WordSize::BLOCK_128> cipher;
+    measure("encrypt(block, key), schedule per block", blocks * 16, [&] {
+        for (size_t i = 0; i < blocks; i++)
+            cipher.encrypt(block, key);
+    });
+
+    cipher.set_key(key);
+    measure("set_key once, encrypt(block)", blocks * 16, [&] {
+        for (size_t i = 0; i < blocks; i++)
+            cipher.encrypt(block);
+    });
+
+    vector<u8> data = random_bytes(blocks * 16);
+    measure("set_key once, encrypt_blocks over 64KB", data.size(),
+            [&] { cipher.encrypt_blocks(data.data(), blocks); });
+}
+
+/// CTR over 16MB serially and on 1 .. N pool threads
+static void bench_ctr()
+{
+    RC6<WordSize::BLOCK_128> cipher(random_bytes(16));
+    ECB<RC6<WordSize::BLOCK_128>> ecb(cipher);
+    CTR<ECB<RC6<WordSize::BLOCK_128>>> ctr(ecb, 16);
+    vector<u8> data = random_bytes(16 << 20);
+    const vector<u8> tag = random_bytes(16);
+
+    measure("crypt, serial", data.size(), [&] { ctr.crypt(data.data(), data.size(), tag.data()); });
+    for (size_t workers = 1; workers <= ThreadPool::shared().concurrency(); workers++)
+        measure("crypt_parallel, " + to_string(workers) + " thread(s)", data.size(),
+                [&] { ctr.crypt_parallel(data.data(), data.size(), tag.data(), workers); });
+}
+
+/**
+ * AEAD open of 16MB, fused decrypt-and-hash over cache-sized tiles against the two passes it replaced:
+ * CTR over the whole buffer, then Polyval over the whole buffer
+ * Both copy the sealed message into the working buffer first, as open decrypts in place
+ */
+static void bench_aead()
+{
+    const vector<u8> kgk = random_bytes(32);
+    AEAD<WordSize::BLOCK_128> aead(kgk);
+    const vector<u8> aad = random_bytes(16);
+    const size_t len = 16 << 20;
+    vector<u8> sealed = random_bytes(len);
+    aead.seal(sealed, aad, false);
+    vector<u8> buffer(sealed.size());
+
+    RC6<WordSize::BLOCK_128> cipher(random_bytes(16));
+    ECB<RC6<WordSize::BLOCK_128>> ecb(cipher);
+    CTR<ECB<RC6<WordSize::BLOCK_128>>> ctr(ecb, 16);
+    const vector<u8> key = random_bytes(16);
+    measure("two passes, CTR then Polyval", len, [&] {
+        memcpy(buffer.data(), sealed.data(), sealed.size());
+        ctr.crypt(buffer.data() + aead.headroom(), len, sealed.data());
+        Polyval<WordSize::BLOCK_128> authenticator(key);
+        authenticator.update(buffer.data() + aead.headroom(), len);
+    });
+
+    for (bool parallel : {false, true})
+        measure(string("fused open, ") + (parallel ? "parallel" : "serial"), len, [&] {
+            memcpy(buffer.data(), sealed.data(), sealed.size());
+            aead.open(buffer.data(), buffer.size(), aad, parallel);
+        });
+}
+
+/**
+ * Polyval over 64KB one block at a time, s = (s + X) * H, through each multiplier: the portable bmul64
+ * Karatsuba, the Shoup byte table for CPUs without carry-less multiply, and PCLMULQDQ where present
+ */
+static void bench_polyval()
+{
+    const vector<u8> data = random_bytes(64 * 1024);
+    const vector<u8> key = random_bytes(16);
+    FieldElement64 h(key);
+    const PolyvalTable table(h);
+    FieldElement64 s(0L, 0L);
+
+    auto per_block = [&](const string& label, const function<FieldElement64(FieldElement64)>& mul_h) {
+        measure(label, data.size(), [&] {
+            for (size_t i = 0; i < data.size(); i += 16)
+                s = mul_h(s + FieldElement64(data.data() + i));
+        });
+    };
+    per_block("bmul64 Karatsuba", [&](FieldElement64 x) { return x.mul_software(h); });
+    per_block("Shoup 8-bit table", [&](FieldElement64 x) { return table.mul(x); });
+    if (cpu::has_pclmul())
+        per_block("PCLMULQDQ", [&](FieldElement64 x) { return x * h; });
+
+    Polyval<WordSize::BLOCK_128> authenticator(key);
+    measure("Polyval::update, dispatched", data.size(),
+            [&] { authenticator.update(data.data(), data.size()); });
+}
+
+/**
+ * PBKDF2-HMAC-SHA256 at the 15000 iterations of a steg/unsteg, SHA-NI where present, against OpenSSL's own
+ */
+static void bench_pbkdf2()
+{
+    const string password = "correct horse battery staple";
+    vector<u8> key(32);
+    measure_rate("fastpbkdf2_hmac_sha256", "derivations", [&] {
+        fastpbkdf2_hmac_sha256((const u8*) password.data(), password.size(), (const u8*) password.data(),
+                               password.size(), 15000, key.data(), key.size());
+    });
+    measure_rate("OpenSSL PKCS5_PBKDF2_HMAC", "derivations", [&] {
+        PKCS5_PBKDF2_HMAC(password.data(), password.size(), (const u8*) password.data(), password.size(),
+                          15000, EVP_sha256(), key.size(), key.data());
+    });
+}
+
+/// Log-like text, compressible the way typical steg inputs are, the same for every run
+static string corpus(size_t len)
+{
+    static const char* const levels[] = {"INFO", "DEBUG", "WARN", "ERROR"};
+    static const char* const actions[] = {"processed request", "opened session", "flushed cache", "retried"};
+    mt19937 rng(7);
+    auto draw = [&](u32 bound) { return (u32) (rng() % bound); };
+    string text;
+    char line[128];
+    while (text.size() < len) {
+        snprintf(line, sizeof(line), "2026-10-17 %02u:%02u:%02u %s worker-%u %s %u in %u ms\n", draw(24),
+                 draw(60), draw(60), levels[draw(4)], draw(16), actions[draw(4)], draw(100000), draw(500));
+        text += line;
+    }
+    text.resize(len);
+    return text;
+}
+
+/**
+ * Deflate level 9 over 16MB of text: the single zlib stream compression used to be, against the
+ * block-parallel format on 1 .. N pool threads, both ways
+ */
+static void bench_compression()
+{
+    const string text = corpus(16 << 20);
+
+    vector<u8> stream(compressBound(text.size()));
+    uLongf stream_len = stream.size();
+    measure("compress, single zlib stream", text.size(), [&] {
+        stream_len = stream.size();
+        compress2(stream.data(), &stream_len, (const u8*) text.data(), text.size(), Z_BEST_COMPRESSION);
+    });
+    vector<u8> restored(text.size());
+    measure("decompress, single zlib stream", text.size(), [&] {
+        uLongf restored_len = restored.size();
+        uncompress(restored.data(), &restored_len, stream.data(), stream_len);
+    });
+
+    vector<u8> blocks;
+    for (size_t workers = 1; workers <= ThreadPool::shared().concurrency(); workers++) {
+        parallel::worker_limit() = workers;
+        const string threads = to_string(workers) + " thread(s)";
+        measure("compress, blocks, " + threads, text.size(), [&] {
+            blocks.clear();
+            compression::compress(text, blocks);
+        });
+        measure("decompress, blocks, " + threads, text.size(), [&] {
+            vector<u8> decompressed;
+            compression::decompress(blocks, decompressed);
+        });
+    }
+    parallel::worker_limit() = 0;
+    cout << setprecision(3) << "  ratio: single stream " << (double) stream_len / text.size() << ", blocks "
+         << (double) blocks.size() / text.size() << "\n";
+}
+
+/// Every codec compiled into this build at its default level over 16MB of text, both ways, and its ratio
+static void bench_codecs()
+{
+    const string text = corpus(16 << 20);
+    vector<string> names = {"deflate"};
+#ifdef WITH_LZMA
+    names.push_back("lzma");
+#endif
+#ifdef WITH_ZSTD
+    names.push_back("zstd");
+#endif
+
+    for (const string& name : names) {
+        vector<u8> payload;
+        measure(name + " compress", text.size(), [&] {
+            payload.clear();
+            compression::compress(text, payload, compression::codec_id(name));
+        });
+        measure(name + " decompress", text.size(), [&] {
+            vector<u8> decompressed;
+            compression::decompress(payload, decompressed);
+        });
+        cout << "  " << name << " ratio " << setprecision(3) << (double) payload.size() / text.size() << "\n";
+    }
+}
+
+/// Codon encoding of 1MB of ciphertext-like bytes and decoding it back, the last step of every steg/unsteg
+static void bench_dna64()
+{
+    const vector<u8> bytes = random_bytes(1 << 20);
+    string encoded;
+    measure("encode", bytes.size(), [&] { encoded = dna64::encode(bytes); });
+    measure("decode", bytes.size(), [&] { dna64::decode(encoded); });
+}
+
+int main(int argc, char** argv)
+{
+    const map<string, function<void()>> cases = {
+        {"aead", bench_aead},
+        {"codecs", bench_codecs},
+        {"compression", bench_compression},
+        {"ctr", bench_ctr},
+        {"dna64", bench_dna64},
+        {"pbkdf2", bench_pbkdf2},
+        {"polyval", bench_polyval},
+        {"rc6", bench_rc6},
+    };
+
+    vector<string> selected(argv + 1, argv + argc);
+    if (selected.empty())
+        for (const auto& entry : cases)
+            selected.push_back(entry.first);
+
+    for (const string& name : selected) {
+        auto it = cases.find(name);
+        if (it == cases.end()) {
+            cerr << "unknown case " << name << ", cases are:";
+            for (const auto& entry : cases)
+                cerr << " " << entry.first;
+            cerr << "\n";
+            return 1;
+        }
+        cout << name << ":\n";
+        it->second();
+    }
+    return 0;
+}
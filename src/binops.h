@@ -10,21 +10,26 @@ using namespace std;
 /**
  * Rotate a N-bit value left
  * @param word: value to rotate
- * @param shift: bits to roll
+ * @param shift: bits to roll, taken modulo N
  */
 template<class T> inline T rol(T word, int shift)
 {
-    return (word << shift) | (word >> (numeric_limits<T>::digits - shift));
+    // Masked so neither shift reaches N, which also lets compilers emit a single rotate instruction
+    const unsigned mask = numeric_limits<T>::digits - 1;
+    const unsigned roll = (unsigned) shift & mask;
+    return (word << roll) | (word >> (-roll & mask));
 }
 
 /**
  * Rotate a N-bit value right
  * @param word: value to rotate
- * @param shift: bits to roll
+ * @param shift: bits to roll, taken modulo N
  */
 template<class T> inline T ror(T word, int shift)
 {
-    return (word >> shift) | (word << (numeric_limits<T>::digits - shift));
+    const unsigned mask = numeric_limits<T>::digits - 1;
+    const unsigned roll = (unsigned) shift & mask;
+    return (word >> roll) | (word << (-roll & mask));
 }
 
 /**
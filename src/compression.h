@@ -1,91 +1,784 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <iostream>
 #include <string>
 #include <vector>
 
+#include <zlib.h>
+#ifdef WITH_LZMA
+#include <lzma.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "obfuscate.h"
+#include "parallel.h"
 #include "types.h"
 
 using namespace std;
 
-#include <cassert>
-#include <zlib.h>
-
-namespace lzma
+namespace compression
 {
-    void compress(const string& src, vector<u8>& dest)
-    {
-        vector<u8> buffer;
-        const size_t BUFSIZE = 128 * 1024;
-        u8 temp_buffer[BUFSIZE];
-
-        z_stream strm;
-        strm.zalloc = 0;
-        strm.zfree = 0;
-        strm.next_in = (u8*) src.data();
-        strm.avail_in = src.size();
-        strm.next_out = temp_buffer;
-        strm.avail_out = BUFSIZE;
-
-        deflateInit(&strm, Z_BEST_COMPRESSION);
-
-        while (strm.avail_in != 0) {
-            int res = deflate(&strm, Z_NO_FLUSH);
-            assert(res == Z_OK);
-            if (strm.avail_out == 0 && res == Z_OK) {
-                buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE);
+    /// Codec identifiers, recorded in the payload header
+    enum class CodecId : u8 { DEFLATE = 0, LZMA = 1, ZSTD = 2, STORED = 3 };
+
+    /// Level argument selecting the codec's own default
+    const int DEFAULT_LEVEL = -1;
+
+    /**
+     * Payload layout: HEADER_MAGIC || codec id (1 byte) || [dictionary id (32-bit little endian)]
+     *                 || codec output
+     * DICTIONARY_FLAG is set in the codec id byte when the payload was compressed with a preset dictionary,
+     * the dictionary id then follows.
+     * Payloads from before codecs were selectable are a bare deflate stream or deflate block format,
+     * neither of which can start with the magic.
+     */
+    const u8 HEADER_MAGIC = 0x43;
+    const size_t HEADER_SIZE = 2;
+    const u8 DICTIONARY_FLAG = 0x80;
+    const size_t DICTIONARY_ID_SIZE = 4;
+
+    inline void put_u32(u8* dest, u32 value)
+    {
+        for (size_t k = 0; k < 4; k++)
+            dest[k] = (u8)(value >> (8 * k));
+    }
+
+    inline u32 get_u32(const u8* src)
+    {
+        u32 value = 0;
+        for (size_t k = 0; k < 4; k++)
+            value |= (u32) src[k] << (8 * k);
+        return value;
+    }
+
+    /**
+     * Add the byte values of a buffer to a histogram
+     * @param src: input
+     * @param len: input byte length
+     * @param counts: occurrences of every byte value, added to
+     */
+    inline void count_bytes(const u8* src, size_t len, array<size_t, 256>& counts)
+    {
+        for (size_t i = 0; i < len; i++)
+            counts[src[i]]++;
+    }
+
+    /**
+     * Order-0 Shannon entropy of a byte histogram
+     * @param counts: occurrences of every byte value
+     * @param total: sum of counts
+     * @return bits per byte, close to 8 for random or already compressed data
+     */
+    inline double entropy(const array<size_t, 256>& counts, size_t total)
+    {
+        double bits = 0;
+        for (size_t count : counts)
+            if (count)
+                bits -= (double) count / total * log2((double) count / total);
+        return bits;
+    }
+
+    /**
+     * Identifier of a preset dictionary, its Adler-32 as in zlib headers
+     * @param dictionary: preset dictionary
+     */
+    inline u32 dictionary_id(const vector<u8>& dictionary)
+    {
+        return adler32(adler32(0, Z_NULL, 0), dictionary.data(), dictionary.size());
+    }
+
+    /// Abstract compression codec interface
+    class Codec
+    {
+      public:
+        virtual ~Codec() = default;
+
+        virtual int default_level() const = 0;
+        virtual int min_level() const = 0;
+        virtual int max_level() const = 0;
+        /// Whether compress() and decompress() make use of a preset dictionary
+        virtual bool supports_dictionary() const { return false; }
+
+        /**
+         * Compress a buffer
+         * @param src: input
+         * @param len: input byte length
+         * @param dest: compressed output, replaced
+         * @param level: compression level within [min_level(), max_level()]
+         * @param dictionary: preset dictionary, empty for none
+         */
+        virtual void compress(const u8* src, size_t len, vector<u8>& dest, int level,
+                              const vector<u8>& dictionary) = 0;
+
+        /**
+         * Decompress a buffer, bytes after the end of the compressed data are ignored
+         * @param src: compressed input
+         * @param len: input byte length
+         * @param dest: decompressed output, replaced and sized to the decompressed length
+         * @param dictionary: preset dictionary the input was compressed with, empty for none
+         * @return false on malformed or truncated input
+         */
+        virtual bool decompress(const u8* src, size_t len, vector<u8>& dest,
+                                const vector<u8>& dictionary) = 0;
+    };
+
+    /**
+     * zlib deflate
+     *
+     * Inputs of up to one block are a single zlib stream, larger ones use the block-parallel format:
+     *   BLOCKS_MAGIC || block count (32-bit little endian) || chain length (1 byte)
+     *   || per block: raw size, compressed size, raw CRC-32 (32-bit little endian each)
+     *   || compressed blocks
+     * Every block is a raw deflate stream of up to BLOCK_SIZE input bytes. Within a chain of CHAIN_BLOCKS
+     * blocks, each block after the first is primed with the last 32 KB of the block before it, pigz style,
+     * so little ratio is lost to the split. Chains are independent of each other, so blocks compress in
+     * parallel and chains decompress in parallel.
+     * Blocks that look random, or that deflate does not shrink, are stored raw and marked with STORED_BLOCK
+     * in their compressed size.
+     * A preset dictionary primes the single stream, and the first block of every chain.
+     * The magic cannot start a zlib or gzip stream, so the two are told apart by their first byte.
+     */
+    class DeflateCodec : public Codec
+    {
+      public:
+        int default_level() const override { return Z_BEST_COMPRESSION; }
+        int min_level() const override { return Z_BEST_SPEED; }
+        int max_level() const override { return Z_BEST_COMPRESSION; }
+        bool supports_dictionary() const override { return true; }
+
+        void compress(const u8* src, size_t len, vector<u8>& dest, int level,
+                      const vector<u8>& dictionary) override
+        {
+            if (len > BLOCK_SIZE)
+                compress_blocks(src, len, dest, level, dictionary);
+            else
+                compress_stream(src, len, dest, level, dictionary);
+        }
+
+        bool decompress(const u8* src, size_t len, vector<u8>& dest, const vector<u8>& dictionary) override
+        {
+            if (len && src[0] == BLOCKS_MAGIC)
+                return decompress_blocks(src, len, dest, dictionary);
+            return decompress_stream(src, len, dest, dictionary);
+        }
+
+      private:
+        static constexpr u8 BLOCKS_MAGIC = 0x50;
+        static constexpr size_t BLOCK_SIZE = 128 * 1024;
+        static constexpr size_t CHAIN_BLOCKS = 8;
+        static constexpr size_t DICTIONARY_SIZE = 32 * 1024;
+        static constexpr size_t BLOCKS_HEADER_SIZE = 1 + 4 + 1;
+        static constexpr size_t BLOCK_ENTRY_SIZE = 3 * 4;
+        static constexpr u32 STORED_BLOCK = (u32) 1 << 31;
+        /// Byte entropy above which a block is stored without trying to deflate it, in bits per byte
+        static constexpr double STORED_BLOCK_ENTROPY = 7.99;
+
+        /**
+         * Compress as a single zlib stream
+         * @param src: input
+         * @param len: input byte length
+         * @param dest: compressed output
+         * @param level: zlib compression level
+         * @param dictionary: preset dictionary, empty for none
+         */
+        static void compress_stream(const u8* src, size_t len, vector<u8>& dest, int level,
+                                    const vector<u8>& dictionary)
+        {
+            vector<u8> buffer;
+            const size_t BUFSIZE = 128 * 1024;
+            u8 temp_buffer[BUFSIZE];
+
+            z_stream strm;
+            strm.zalloc = 0;
+            strm.zfree = 0;
+            strm.next_in = (u8*) src;
+            strm.avail_in = len;
+            strm.next_out = temp_buffer;
+            strm.avail_out = BUFSIZE;
+
+            deflateInit(&strm, level);
+            // The zlib header records the dictionary's Adler-32, inflate asks for it by that
+            if (!dictionary.empty())
+                deflateSetDictionary(&strm, dictionary.data(), dictionary.size());
+
+            while (strm.avail_in != 0) {
+                int res = deflate(&strm, Z_NO_FLUSH);
+                assert(res == Z_OK);
+                if (strm.avail_out == 0 && res == Z_OK) {
+                    buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE);
+                    strm.next_out = temp_buffer;
+                    strm.avail_out = BUFSIZE;
+                }
+            }
+
+            int deflate_res = Z_OK;
+            while (deflate_res == Z_OK) {
+                if (strm.avail_out == 0) {
+                    buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE);
+                    strm.next_out = temp_buffer;
+                    strm.avail_out = BUFSIZE;
+                }
+                deflate_res = deflate(&strm, Z_FINISH);
+            }
+
+            assert(deflate_res == Z_STREAM_END);
+            buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE - strm.avail_out);
+            deflateEnd(&strm);
+            dest.swap(buffer);
+        }
+
+        /**
+         * Decompress a single zlib or gzip stream, inflating in chunks into output that grows as needed
+         * @param src: compressed input
+         * @param len: input byte length
+         * @param dest: decompressed output, replaced and sized to the decompressed length
+         * @param dictionary: preset dictionary, supplied when the stream asks for one
+         */
+        static bool decompress_stream(const u8* src, size_t len, vector<u8>& dest,
+                                      const vector<u8>& dictionary)
+        {
+            vector<u8> buffer;
+            const size_t BUFSIZE = 128 * 1024;
+            u8 temp_buffer[BUFSIZE];
+
+            z_stream strm{};
+            strm.next_in = (u8*) src;
+            strm.avail_in = len;
+
+            // 15 window bits, and the +32 tells zlib to detect if using gzip or zlib
+            int err = inflateInit2(&strm, 15 + 32);
+            while (err == Z_OK) {
                 strm.next_out = temp_buffer;
                 strm.avail_out = BUFSIZE;
+                err = inflate(&strm, Z_NO_FLUSH);
+                buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE - strm.avail_out);
+                if (err == Z_NEED_DICT && !dictionary.empty())
+                    err = inflateSetDictionary(&strm, dictionary.data(), dictionary.size());
+            }
+            inflateEnd(&strm);
+
+            if (err != Z_STREAM_END)
+                return false;
+            dest.swap(buffer);
+            return true;
+        }
+
+        /**
+         * Compress one block as a raw deflate stream
+         * @param src: whole input
+         * @param begin: block offset
+         * @param len: block byte length
+         * @param dictionary: bytes to prime the window with
+         * @param dictionary_len: byte length of the priming bytes, 0 for none
+         * @param level: zlib compression level
+         */
+        static vector<u8> compress_block(const u8* src, size_t begin, size_t len, const u8* dictionary,
+                                         size_t dictionary_len, int level)
+        {
+            z_stream strm{};
+            deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+            if (dictionary_len)
+                deflateSetDictionary(&strm, dictionary, dictionary_len);
+
+            // Bound covers the whole block, so a single call finishes the stream
+            vector<u8> block(deflateBound(&strm, len));
+            strm.next_in = (u8*) src + begin;
+            strm.avail_in = len;
+            strm.next_out = block.data();
+            strm.avail_out = block.size();
+            int res = deflate(&strm, Z_FINISH);
+            assert(res == Z_STREAM_END);
+            (void) res;
+            block.resize(strm.total_out);
+            deflateEnd(&strm);
+            return block;
+        }
+
+        /**
+         * Decompress one raw deflate block in place in the output
+         * @param src: compressed block
+         * @param len: compressed byte length
+         * @param dest: whole output
+         * @param begin: block offset in the output
+         * @param raw_len: decompressed byte length
+         * @param dictionary: bytes the window was primed with
+         * @param dictionary_len: byte length of the priming bytes, 0 for none
+         */
+        static bool decompress_block(const u8* src, size_t len, u8* dest, size_t begin, size_t raw_len,
+                                     const u8* dictionary, size_t dictionary_len)
+        {
+            z_stream strm{};
+            inflateInit2(&strm, -15);
+            if (dictionary_len)
+                inflateSetDictionary(&strm, dictionary, dictionary_len);
+
+            strm.next_in = (u8*) src;
+            strm.avail_in = len;
+            strm.next_out = dest + begin;
+            strm.avail_out = raw_len;
+            int res = inflate(&strm, Z_FINISH);
+            inflateEnd(&strm);
+            return res == Z_STREAM_END && strm.total_out == raw_len;
+        }
+
+        /**
+         * Compress in the block-parallel format, blocks are compressed concurrently on the shared pool
+         * @param src: input of at least two blocks
+         * @param len: input byte length
+         * @param dest: compressed output
+         * @param level: zlib compression level
+         * @param dictionary: preset dictionary for the first block of every chain, empty for none
+         */
+        static void compress_blocks(const u8* src, size_t len, vector<u8>& dest, int level,
+                                    const vector<u8>& dictionary)
+        {
+            const size_t preset_len = min(dictionary.size(), DICTIONARY_SIZE);
+            const u8* preset = dictionary.data() + dictionary.size() - preset_len;
+
+            const size_t blocks = (len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            vector<vector<u8>> compressed(blocks);
+            vector<char> stored(blocks, false);
+            vector<u32> checksums(blocks);
+
+            parallel::for_each_range(blocks, 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    const size_t offset = i * BLOCK_SIZE;
+                    const size_t block_len = min(BLOCK_SIZE, len - offset);
+                    checksums[i] = crc32(0, src + offset, block_len);
+
+                    array<size_t, 256> counts{};
+                    count_bytes(src + offset, block_len, counts);
+                    if (entropy(counts, block_len) < STORED_BLOCK_ENTROPY) {
+                        // Blocks after the first in a chain are primed with the input preceding them
+                        const size_t primed_len =
+                            i % CHAIN_BLOCKS ? min(offset, DICTIONARY_SIZE) : preset_len;
+                        const u8* primed = i % CHAIN_BLOCKS ? src + offset - primed_len : preset;
+                        compressed[i] = compress_block(src, offset, block_len, primed, primed_len, level);
+                    }
+                    stored[i] = compressed[i].empty() || compressed[i].size() >= block_len;
+                    if (stored[i])
+                        compressed[i].assign(src + offset, src + offset + block_len);
+                }
+            });
+
+            size_t total = BLOCKS_HEADER_SIZE + blocks * BLOCK_ENTRY_SIZE;
+            for (const vector<u8>& block : compressed)
+                total += block.size();
+
+            vector<u8> buffer(total);
+            buffer[0] = BLOCKS_MAGIC;
+            put_u32(&buffer[1], blocks);
+            buffer[5] = CHAIN_BLOCKS;
+            u8* entry = buffer.data() + BLOCKS_HEADER_SIZE;
+            u8* out = entry + blocks * BLOCK_ENTRY_SIZE;
+            for (size_t i = 0; i < blocks; i++, entry += BLOCK_ENTRY_SIZE) {
+                put_u32(entry, min(BLOCK_SIZE, len - i * BLOCK_SIZE));
+                put_u32(entry + 4, compressed[i].size() | (stored[i] ? STORED_BLOCK : 0));
+                put_u32(entry + 8, checksums[i]);
+                out = copy(compressed[i].begin(), compressed[i].end(), out);
+            }
+            dest.swap(buffer);
+        }
+
+        /**
+         * Decompress the block-parallel format, chains are decompressed concurrently on the shared pool
+         * @param src: compressed input starting with BLOCKS_MAGIC
+         * @param len: input byte length
+         * @param dest: decompressed output, sized once to the length recorded in the block table
+         * @param dictionary: preset dictionary the input was compressed with, empty for none
+         */
+        static bool decompress_blocks(const u8* src, size_t len, vector<u8>& dest,
+                                      const vector<u8>& dictionary)
+        {
+            const size_t preset_len = min(dictionary.size(), DICTIONARY_SIZE);
+            const u8* preset = dictionary.data() + dictionary.size() - preset_len;
+
+            if (len < BLOCKS_HEADER_SIZE)
+                return false;
+            const size_t blocks = get_u32(&src[1]);
+            const size_t chain_blocks = src[5];
+            if (chain_blocks == 0 || blocks > (len - BLOCKS_HEADER_SIZE) / BLOCK_ENTRY_SIZE)
+                return false;
+
+            // Raw and compressed offsets of every block, from the block table
+            vector<size_t> raw_offsets(blocks + 1, 0);
+            vector<size_t> offsets(blocks + 1, BLOCKS_HEADER_SIZE + blocks * BLOCK_ENTRY_SIZE);
+            const u8* entry = src + BLOCKS_HEADER_SIZE;
+            for (size_t i = 0; i < blocks; i++, entry += BLOCK_ENTRY_SIZE) {
+                const u32 raw_len = get_u32(entry);
+                const u32 compressed_len = get_u32(entry + 4) & ~STORED_BLOCK;
+                const bool stored = get_u32(entry + 4) & STORED_BLOCK;
+                if (raw_len > BLOCK_SIZE || (stored && compressed_len != raw_len))
+                    return false;
+                raw_offsets[i + 1] = raw_offsets[i] + raw_len;
+                offsets[i + 1] = offsets[i] + compressed_len;
             }
+            // Like a zlib stream, trailing bytes after the last block are ignored
+            if (offsets[blocks] > len)
+                return false;
+
+            vector<u8> buffer(raw_offsets[blocks]);
+            const size_t chains = (blocks + chain_blocks - 1) / chain_blocks;
+            vector<char> failed(chains, false);
+            parallel::for_each_range(chains, 1, [&](size_t begin, size_t end) {
+                for (size_t chain = begin; chain < end; chain++) {
+                    const size_t last = min(blocks, (chain + 1) * chain_blocks);
+                    for (size_t i = chain * chain_blocks; i < last && !failed[chain]; i++) {
+                        const u8* block_entry = src + BLOCKS_HEADER_SIZE + i * BLOCK_ENTRY_SIZE;
+                        const u8* block = src + offsets[i];
+                        const size_t block_len = offsets[i + 1] - offsets[i];
+                        const size_t raw_len = raw_offsets[i + 1] - raw_offsets[i];
+                        u8* out = buffer.data() + raw_offsets[i];
+
+                        // Blocks after the first in a chain were primed with the output preceding them
+                        const size_t primed_len =
+                            i % chain_blocks ? min(raw_offsets[i], DICTIONARY_SIZE) : preset_len;
+                        const u8* primed = i % chain_blocks ? out - primed_len : preset;
+
+                        bool ok = true;
+                        if (get_u32(block_entry + 4) & STORED_BLOCK)
+                            copy(block, block + block_len, out);
+                        else
+                            ok = decompress_block(block, block_len, buffer.data(), raw_offsets[i], raw_len,
+                                                  primed, primed_len);
+                        failed[chain] = !ok || crc32(0, out, raw_len) != get_u32(block_entry + 8);
+                    }
+                }
+            });
+
+            if (find(failed.begin(), failed.end(), true) != failed.end())
+                return false;
+            dest.swap(buffer);
+            return true;
+        }
+    };
+
+    /**
+     * Uncompressed input, for data compression would not shrink
+     * Layout: input byte length (64-bit little endian) || input
+     */
+    class StoredCodec : public Codec
+    {
+      public:
+        static constexpr size_t LENGTH_SIZE = 8;
+
+        int default_level() const override { return 0; }
+        int min_level() const override { return 0; }
+        int max_level() const override { return 0; }
+
+        void compress(const u8* src, size_t len, vector<u8>& dest, int, const vector<u8>&) override
+        {
+            vector<u8> buffer(LENGTH_SIZE + len);
+            for (size_t k = 0; k < LENGTH_SIZE; k++)
+                buffer[k] = (u8)((u64) len >> (8 * k));
+            copy(src, src + len, buffer.begin() + LENGTH_SIZE);
+            dest.swap(buffer);
+        }
+
+        bool decompress(const u8* src, size_t len, vector<u8>& dest, const vector<u8>&) override
+        {
+            if (len < LENGTH_SIZE)
+                return false;
+            u64 stored_len = 0;
+            for (size_t k = 0; k < LENGTH_SIZE; k++)
+                stored_len |= (u64) src[k] << (8 * k);
+            if (stored_len > len - LENGTH_SIZE)
+                return false;
+            dest.assign(src + LENGTH_SIZE, src + LENGTH_SIZE + stored_len);
+            return true;
+        }
+    };
+
+#ifdef WITH_LZMA
+    /// xz container with LZMA2, through liblzma
+    class LzmaCodec : public Codec
+    {
+      public:
+        int default_level() const override { return LZMA_PRESET_DEFAULT; }
+        int min_level() const override { return 0; }
+        int max_level() const override { return 9; }
+
+        void compress(const u8* src, size_t len, vector<u8>& dest, int level, const vector<u8>&) override
+        {
+            vector<u8> buffer(lzma_stream_buffer_bound(len));
+            size_t out_len = 0;
+            lzma_ret res = lzma_easy_buffer_encode(level, LZMA_CHECK_CRC32, nullptr, src, len, buffer.data(),
+                                                   &out_len, buffer.size());
+            assert(res == LZMA_OK);
+            (void) res;
+            buffer.resize(out_len);
+            dest.swap(buffer);
         }
 
-        int deflate_res = Z_OK;
-        while (deflate_res == Z_OK) {
-            if (strm.avail_out == 0) {
-                buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE);
+        bool decompress(const u8* src, size_t len, vector<u8>& dest, const vector<u8>&) override
+        {
+            vector<u8> buffer;
+            const size_t BUFSIZE = 128 * 1024;
+            u8 temp_buffer[BUFSIZE];
+
+            lzma_stream strm = LZMA_STREAM_INIT;
+            // Without LZMA_CONCATENATED decoding stops at the end of the first stream
+            lzma_ret res = lzma_stream_decoder(&strm, UINT64_MAX, 0);
+            strm.next_in = src;
+            strm.avail_in = len;
+            while (res == LZMA_OK) {
                 strm.next_out = temp_buffer;
                 strm.avail_out = BUFSIZE;
+                res = lzma_code(&strm, LZMA_FINISH);
+                buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE - strm.avail_out);
             }
-            deflate_res = deflate(&strm, Z_FINISH);
+            lzma_end(&strm);
+
+            if (res != LZMA_STREAM_END)
+                return false;
+            dest.swap(buffer);
+            return true;
+        }
+    };
+#endif
+
+#ifdef WITH_ZSTD
+    /// Zstandard single frame, with the content size recorded so output is allocated exactly once
+    class ZstdCodec : public Codec
+    {
+      public:
+        int default_level() const override { return ZSTD_CLEVEL_DEFAULT; }
+        int min_level() const override { return 1; }
+        int max_level() const override { return ZSTD_maxCLevel(); }
+        bool supports_dictionary() const override { return true; }
+
+        void compress(const u8* src, size_t len, vector<u8>& dest, int level,
+                      const vector<u8>& dictionary) override
+        {
+            vector<u8> buffer(ZSTD_compressBound(len));
+            ZSTD_CCtx* context = ZSTD_createCCtx();
+            const size_t out_len = ZSTD_compress_usingDict(context, buffer.data(), buffer.size(), src, len,
+                                                           dictionary.data(), dictionary.size(), level);
+            ZSTD_freeCCtx(context);
+            assert(!ZSTD_isError(out_len));
+            buffer.resize(out_len);
+            dest.swap(buffer);
+        }
+
+        bool decompress(const u8* src, size_t len, vector<u8>& dest, const vector<u8>& dictionary) override
+        {
+            const size_t frame_len = ZSTD_findFrameCompressedSize(src, len);
+            const unsigned long long content_len = ZSTD_getFrameContentSize(src, len);
+            if (ZSTD_isError(frame_len) || content_len == ZSTD_CONTENTSIZE_UNKNOWN ||
+                content_len == ZSTD_CONTENTSIZE_ERROR)
+                return false;
+
+            vector<u8> buffer(content_len);
+            ZSTD_DCtx* context = ZSTD_createDCtx();
+            const size_t out_len = ZSTD_decompress_usingDict(context, buffer.data(), buffer.size(), src,
+                                                             frame_len, dictionary.data(), dictionary.size());
+            ZSTD_freeDCtx(context);
+            if (ZSTD_isError(out_len) || out_len != content_len)
+                return false;
+            dest.swap(buffer);
+            return true;
         }
+    };
+#endif
 
-        assert(deflate_res == Z_STREAM_END);
-        buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE - strm.avail_out);
-        deflateEnd(&strm);
-        dest.swap(buffer);
+    /**
+     * Codec for an identifier, exits if it is not compiled into this build
+     * @param id: codec identifier
+     */
+    inline Codec& codec(CodecId id)
+    {
+        switch (id) {
+        case CodecId::DEFLATE: {
+            static DeflateCodec deflate;
+            return deflate;
+        }
+        case CodecId::STORED: {
+            static StoredCodec stored;
+            return stored;
+        }
+#ifdef WITH_LZMA
+        case CodecId::LZMA: {
+            static LzmaCodec lzma;
+            return lzma;
+        }
+#endif
+#ifdef WITH_ZSTD
+        case CodecId::ZSTD: {
+            static ZstdCodec zstd;
+            return zstd;
+        }
+#endif
+        default:
+            break;
+        }
+
+        string error = "ERROR: Compression codec is not supported by this build, codec id "_hidden;
+        cerr << error << (int) id << ".\n";
+        exit(1);
     }
 
-    size_t decompress(const vector<u8>& src, vector<u8>& dest)
-    {
-        z_stream strm;
-        strm.total_in = strm.avail_in = src.size();
-        strm.next_in = (u8*) src.data();
-        strm.next_out = (u8*) dest.data();
-
-        strm.zalloc = Z_NULL;
-        strm.zfree = Z_NULL;
-        strm.opaque = Z_NULL;
-        strm.total_out = deflateBound(&strm, strm.total_in);
-        strm.avail_out = dest.size();
-
-        int err = -1;
-        int ret = -1;
-
-        err = inflateInit2(
-            &strm, (15 + 32)); // 15 window bits, and the +32 tells zlib to to detect if using gzip or zlib
-        if (err == Z_OK) {
-            err = inflate(&strm, Z_FINISH);
-            if (err == Z_STREAM_END) {
-                ret = strm.total_out;
-            } else {
-                inflateEnd(&strm);
-                return err;
-            }
-        } else {
-            inflateEnd(&strm);
-            return err;
+    /**
+     * Look up a codec identifier by its command line name, exits on an unknown name
+     * @param name: deflate, lzma or zstd
+     */
+    inline CodecId codec_id(const string& name)
+    {
+        string deflate = "deflate"_hidden, lzma = "lzma"_hidden, zstd = "zstd"_hidden;
+        if (name == deflate)
+            return CodecId::DEFLATE;
+        if (name == lzma)
+            return CodecId::LZMA;
+        if (name == zstd)
+            return CodecId::ZSTD;
+
+        string error = "ERROR: Unknown compression codec '"_hidden;
+        string post = "', expected deflate, lzma or zstd.\n"_hidden;
+        cerr << error << name << post;
+        exit(1);
+    }
+
+    /// Inputs sampled by worth_compressing() in up to PROBE_WINDOWS windows of PROBE_WINDOW_SIZE bytes
+    const size_t PROBE_WINDOWS = 16;
+    const size_t PROBE_WINDOW_SIZE = 4096;
+    /// Sample byte entropy below which input is compressed without a trial, in bits per byte
+    const double PROBE_COMPRESSIBLE_ENTROPY = 7.5;
+    /// Fast trial ratio on the sample above which input is stored
+    const double PROBE_INCOMPRESSIBLE_RATIO = 0.97;
+
+    /**
+     * Estimate from a sample whether a full compression pass would pay off
+     * Windows spread evenly over the input are sampled. A byte entropy clearly below 8 bits settles it,
+     * otherwise the windows are deflated at the fastest level, which also finds repetition entropy misses.
+     * @param src: input
+     * @param len: input byte length
+     * @return false for input that looks random or already compressed
+     */
+    inline bool worth_compressing(const u8* src, size_t len)
+    {
+        // Small inputs are cheap to compress outright and compare
+        if (len < PROBE_WINDOWS * PROBE_WINDOW_SIZE)
+            return true;
+
+        const size_t stride = (len - PROBE_WINDOW_SIZE) / (PROBE_WINDOWS - 1);
+        array<size_t, 256> counts{};
+        for (size_t w = 0; w < PROBE_WINDOWS; w++)
+            count_bytes(src + w * stride, PROBE_WINDOW_SIZE, counts);
+        if (entropy(counts, PROBE_WINDOWS * PROBE_WINDOW_SIZE) < PROBE_COMPRESSIBLE_ENTROPY)
+            return true;
+
+        size_t compressed = 0;
+        vector<u8> trial;
+        for (size_t w = 0; w < PROBE_WINDOWS; w++) {
+            z_stream strm{};
+            deflateInit2(&strm, Z_BEST_SPEED, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+            trial.resize(deflateBound(&strm, PROBE_WINDOW_SIZE));
+            strm.next_in = (u8*) src + w * stride;
+            strm.avail_in = PROBE_WINDOW_SIZE;
+            strm.next_out = trial.data();
+            strm.avail_out = trial.size();
+            deflate(&strm, Z_FINISH);
+            compressed += strm.total_out;
+            deflateEnd(&strm);
         }
+        return compressed < PROBE_INCOMPRESSIBLE_RATIO * PROBE_WINDOWS * PROBE_WINDOW_SIZE;
+    }
 
-        inflateEnd(&strm);
-        return ret;
+    /**
+     * Check a codec can compress with a level and dictionary, exits if it cannot
+     * @param id: codec to compress with
+     * @param level: codec compression level, DEFAULT_LEVEL for the codec's default
+     * @param dictionary: preset dictionary, empty for none
+     * @return level, the codec's default for DEFAULT_LEVEL
+     */
+    inline int check_settings(CodecId id, int level, const vector<u8>& dictionary)
+    {
+        Codec& selected = codec(id);
+        if (level == DEFAULT_LEVEL)
+            level = selected.default_level();
+        if (level < selected.min_level() || level > selected.max_level()) {
+            string error = "ERROR: Compression level must be between "_hidden;
+            string conjunction = " and "_hidden;
+            string post = " for this codec, got "_hidden;
+            cerr << error << selected.min_level() << conjunction << selected.max_level() << post << level
+                 << ".\n";
+            exit(1);
+        }
+        if (!dictionary.empty() && !selected.supports_dictionary()) {
+            string error = "ERROR: Only the deflate and zstd codecs support preset dictionaries.\n"_hidden;
+            cerr << error;
+            exit(1);
+        }
+        return level;
+    }
+
+    /**
+     * Compress with a codec, recording the codec in the payload header
+     * Input that a sample shows to be incompressible, or that the codec does not shrink, is stored instead
+     * @param src: input
+     * @param dest: payload output
+     * @param id: codec to compress with
+     * @param level: codec compression level, DEFAULT_LEVEL for the codec's default
+     * @param dictionary: preset dictionary, empty for none
+     * @return codec the payload was written with
+     */
+    inline CodecId compress(const string& src, vector<u8>& dest, CodecId id = CodecId::DEFLATE,
+                            int level = DEFAULT_LEVEL, const vector<u8>& dictionary = {})
+    {
+        Codec& selected = codec(id);
+        level = check_settings(id, level, dictionary);
+
+        vector<u8> compressed;
+        const bool compress = worth_compressing((const u8*) src.data(), src.size());
+        if (compress)
+            selected.compress((const u8*) src.data(), src.size(), compressed, level, dictionary);
+        if (!compress || compressed.size() >= StoredCodec::LENGTH_SIZE + src.size()) {
+            id = CodecId::STORED;
+            codec(id).compress((const u8*) src.data(), src.size(), compressed, 0, {});
+        }
+
+        const bool with_dictionary = !dictionary.empty() && id != CodecId::STORED;
+        const size_t header_size = HEADER_SIZE + (with_dictionary ? DICTIONARY_ID_SIZE : 0);
+        dest.resize(header_size + compressed.size());
+        dest[0] = HEADER_MAGIC;
+        dest[1] = (u8) id | (with_dictionary ? DICTIONARY_FLAG : 0);
+        if (with_dictionary)
+            put_u32(&dest[HEADER_SIZE], dictionary_id(dictionary));
+        copy(compressed.begin(), compressed.end(), dest.begin() + header_size);
+        return id;
+    }
+
+    /**
+     * Decompress a payload with the codec recorded in its header
+     * @param src: payload
+     * @param dest: decompressed output, replaced and sized to the decompressed length
+     * @param dictionary: preset dictionary, exits if the payload needs a different one
+     * @return false on malformed or truncated input
+     */
+    inline bool decompress(const vector<u8>& src, vector<u8>& dest, const vector<u8>& dictionary = {})
+    {
+        // Payload from before codecs were selectable
+        if (src.size() < HEADER_SIZE || src[0] != HEADER_MAGIC)
+            return codec(CodecId::DEFLATE).decompress(src.data(), src.size(), dest, {});
+
+        const CodecId id = (CodecId)(src[1] & ~DICTIONARY_FLAG);
+        if (!(src[1] & DICTIONARY_FLAG))
+            return codec(id).decompress(src.data() + HEADER_SIZE, src.size() - HEADER_SIZE, dest, {});
+
+        const size_t header_size = HEADER_SIZE + DICTIONARY_ID_SIZE;
+        if (src.size() < header_size)
+            return false;
+        const u32 id_needed = get_u32(&src[HEADER_SIZE]);
+        if (dictionary.empty() || dictionary_id(dictionary) != id_needed) {
+            string error = "ERROR: Payload needs the preset dictionary with id "_hidden;
+            cerr << error << hex << id_needed << dec << ".\n";
+            exit(1);
+        }
+        return codec(id).decompress(src.data() + header_size, src.size() - header_size, dest, dictionary);
     }
-} // namespace lzma
+} // namespace compression
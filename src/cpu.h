@@ -0,0 +1,71 @@
+#pragma once
+
+/// Runtime CPU feature detection for vectorized code paths
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ENV_X86
+#include <cpuid.h>
+#endif
+
+namespace cpu
+{
+#ifdef ENV_X86
+    /**
+     * Check the OS saves YMM registers across context switches (OSXSAVE + XCR0 SSE/AVX state)
+     */
+    inline bool os_saves_ymm()
+    {
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE))
+            return false;
+
+        unsigned xcr0_lo, xcr0_hi;
+        __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        return (xcr0_lo & 0x6) == 0x6;
+    }
+
+    /**
+     * Check for AVX2 support, detected once
+     */
+    inline bool has_avx2()
+    {
+        static const bool supported = [] {
+            unsigned eax, ebx, ecx, edx;
+            if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+                return false;
+            return (ebx & bit_AVX2) && os_saves_ymm();
+        }();
+        return supported;
+    }
+
+    /**
+     * Check for PCLMULQDQ carry-less multiply support, detected once
+     */
+    inline bool has_pclmul()
+    {
+        static const bool supported = [] {
+            unsigned eax, ebx, ecx, edx;
+            return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL);
+        }();
+        return supported;
+    }
+
+    /**
+     * Check for VPCLMULQDQ on 256-bit registers, detected once
+     */
+    inline bool has_vpclmulqdq()
+    {
+        static const bool supported = [] {
+            unsigned eax, ebx, ecx, edx;
+            if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+                return false;
+            return (ecx & bit_VPCLMULQDQ) && has_avx2() && has_pclmul();
+        }();
+        return supported;
+    }
+#else
+    inline bool has_avx2() { return false; }
+    inline bool has_pclmul() { return false; }
+    inline bool has_vpclmulqdq() { return false; }
+#endif
+} // namespace cpu
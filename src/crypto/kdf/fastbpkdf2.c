@@ -8,6 +8,13 @@
 
 #include <openssl/sha.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WITH_SHA_NI
+#define WITH_AVX2
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 /* --- MSVC doesn't support C99 --- */
 #ifdef _MSC_VER
 #define restrict
@@ -17,6 +24,9 @@
 /* --- Common useful things --- */
 #define MIN(a, b) ((a) > (b)) ? (b) : (a)
 
+/* CPU features fastpbkdf2_sha256_hide_features() keeps the dispatch from using. */
+static unsigned hidden_features;
+
 static inline void write32_be(uint32_t n, uint8_t out[4])
 {
 #if defined(__GNUC__) && __GNUC__ >= 4 && __BYTE_ORDER == __LITTLE_ENDIAN
@@ -282,6 +292,361 @@ static inline void sha256_xor(SHA256_CTX* restrict out, const SHA256_CTX* restri
 DECL_PBKDF2(sha256, SHA256_CBLOCK, SHA256_DIGEST_LENGTH, SHA256_CTX, SHA256_Init, SHA256_Update,
             SHA256_Transform, SHA256_Final, sha256_cpy, sha256_extract, sha256_xor)
 
+/* --- SHA-256 round constants for the x86 paths below --- */
+#if defined(WITH_SHA_NI) || defined(WITH_AVX2)
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+#endif
+
+/* --- SHA-NI (x86 SHA extensions) PBKDF2-HMAC-SHA256 --- */
+#ifdef WITH_SHA_NI
+/* SHA extensions (CPUID leaf 7 EBX bit 29) plus the SSSE3/SSE4.1 shuffles around them, detected once. */
+static int sha_ni_supported(void)
+{
+    static int supported = -1;
+    if (supported < 0) {
+        unsigned eax, ebx, ecx, edx;
+        supported = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3) && (ecx & bit_SSE4_1) &&
+                    __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+    }
+    return supported && !(hidden_features & FASTPBKDF2_SHA_NI);
+}
+
+/* Load a state in A..H order into the ABEF/CDGH layout of the SHA-NI rounds. */
+__attribute__((target("sha,sse4.1,ssse3"))) static inline void
+sha256_ni_load(const uint32_t h[8], __m128i* abef, __m128i* cdgh)
+{
+    __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) h), 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) (h + 4)), 0x1b);
+    *abef = _mm_alignr_epi8(cdab, efgh, 8);
+    *cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+}
+
+/* Unpack ABEF/CDGH into state words A..D and E..H, lane 0 first, the layout of message words. */
+__attribute__((target("sha,sse4.1,ssse3"))) static inline void
+sha256_ni_words(__m128i abef, __m128i cdgh, __m128i* abcd, __m128i* efgh)
+{
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    *abcd = _mm_blend_epi16(feba, dchg, 0xf0);
+    *efgh = _mm_alignr_epi8(dchg, feba, 8);
+}
+
+/* Compress one block of message words W0..W15 (4 per register, lane 0 first) into an ABEF/CDGH state. */
+__attribute__((target("sha,sse4.1,ssse3"))) static inline void
+sha256_ni_compress(__m128i* abef, __m128i* cdgh, const __m128i words[4])
+{
+    __m128i msg[4] = {words[0], words[1], words[2], words[3]};
+    __m128i state0 = *abef;
+    __m128i state1 = *cdgh;
+
+#pragma GCC unroll 16
+    for (int q = 0; q < 16; q++) {
+        /* Four rounds, two per instruction */
+        __m128i wk = _mm_add_epi32(msg[q & 3], _mm_loadu_si128((const __m128i*) &sha256_k[4 * q]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0e));
+
+        /* Schedule W[4q + 16 .. 4q + 19] into the slot just consumed */
+        if (q < 12) {
+            __m128i next = _mm_sha256msg1_epu32(msg[q & 3], msg[(q + 1) & 3]);
+            next = _mm_add_epi32(next, _mm_alignr_epi8(msg[(q + 3) & 3], msg[(q + 2) & 3], 4));
+            msg[q & 3] = _mm_sha256msg2_epu32(next, msg[(q + 3) & 3]);
+        }
+    }
+
+    *abef = _mm_add_epi32(*abef, state0);
+    *cdgh = _mm_add_epi32(*cdgh, state1);
+}
+
+/* PBKDF2 block function with iterations 2..c kept in SHA-NI registers: the inner and outer start states,
+ * the running U and the XOR of all U never leave them, and U needs no byte swapping between the two
+ * hashes since the digest words are already the message words of the next block.  Runs up to NI_LANES
+ * independent (password, salt, block counter) jobs interleaved, so the rounds of one fill the latency of
+ * the others. */
+#define NI_LANES 4
+__attribute__((target("sha,sse4.1,ssse3"))) static void
+pbkdf2_f_sha256_ni(const uint8_t* const* pw, const size_t* npw, const uint8_t* const* salt,
+                   const size_t* nsalt, const uint32_t* counter, int lanes, uint32_t iterations,
+                   uint8_t (*out)[SHA256_DIGEST_LENGTH])
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i U[NI_LANES][4];
+    __m128i result[NI_LANES][2];
+    __m128i inner[NI_LANES][2];
+    __m128i outer[NI_LANES][2];
+
+    for (int l = 0; l < lanes; l++) {
+        uint8_t countbuf[4];
+        write32_be(counter[l], countbuf);
+
+        /* First iteration:
+         *   U_1 = PRF(P, S || INT_32_BE(i))
+         */
+        uint8_t Ublock[SHA256_DIGEST_LENGTH];
+        HMAC_CTX(sha256) ctx;
+        HMAC_INIT(sha256)(&ctx, pw[l], npw[l]);
+        sha256_ni_load(ctx.inner.h, &inner[l][0], &inner[l][1]);
+        sha256_ni_load(ctx.outer.h, &outer[l][0], &outer[l][1]);
+        HMAC_UPDATE(sha256)(&ctx, salt[l], nsalt[l]);
+        HMAC_UPDATE(sha256)(&ctx, countbuf, sizeof countbuf);
+        HMAC_FINAL(sha256)(&ctx, Ublock);
+
+        U[l][0] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) Ublock), bswap);
+        U[l][1] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (Ublock + 16)), bswap);
+        /* Loop-invariant padding of a 32-byte message after the 64-byte key block */
+        U[l][2] = _mm_set_epi32(0, 0, 0, (int) 0x80000000);
+        U[l][3] = _mm_set_epi32((SHA256_CBLOCK + SHA256_DIGEST_LENGTH) * 8, 0, 0, 0);
+        result[l][0] = U[l][0];
+        result[l][1] = U[l][1];
+    }
+
+    /* Subsequent iterations:
+     *   U_c = PRF(P, U_{c-1})
+     */
+    for (uint32_t i = 1; i < iterations; i++) {
+        for (int l = 0; l < lanes; l++) {
+            __m128i abef = inner[l][0];
+            __m128i cdgh = inner[l][1];
+            sha256_ni_compress(&abef, &cdgh, U[l]);
+            sha256_ni_words(abef, cdgh, &U[l][0], &U[l][1]);
+
+            abef = outer[l][0];
+            cdgh = outer[l][1];
+            sha256_ni_compress(&abef, &cdgh, U[l]);
+            sha256_ni_words(abef, cdgh, &U[l][0], &U[l][1]);
+
+            result[l][0] = _mm_xor_si128(result[l][0], U[l][0]);
+            result[l][1] = _mm_xor_si128(result[l][1], U[l][1]);
+        }
+    }
+
+    for (int l = 0; l < lanes; l++) {
+        _mm_storeu_si128((__m128i*) out[l], _mm_shuffle_epi8(result[l][0], bswap));
+        _mm_storeu_si128((__m128i*) (out[l] + 16), _mm_shuffle_epi8(result[l][1], bswap));
+    }
+}
+
+#endif
+
+/* --- Multi-buffer AVX2 PBKDF2-HMAC-SHA256, one independent derivation per 32-bit lane --- */
+#ifdef WITH_AVX2
+#define X8_LANES 8
+/* Fewest jobs for which the eight AVX2 lanes beat running them one by one through OpenSSL */
+#define X8_MIN_JOBS 3
+
+/* AVX2 with YMM state saved by the OS (OSXSAVE and XCR0 SSE/AVX bits), detected once. */
+static int avx2_supported(void)
+{
+    static int supported = -1;
+    if (supported < 0) {
+        unsigned eax, ebx, ecx, edx;
+        int ymm_saved = 0;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_OSXSAVE)) {
+            unsigned xcr0_lo, xcr0_hi;
+            __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+            (void) xcr0_hi;
+            ymm_saved = (xcr0_lo & 0x6) == 0x6;
+        }
+        supported = ymm_saved && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2);
+    }
+    return supported && !(hidden_features & FASTPBKDF2_AVX2);
+}
+
+#define X8_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+#define X8_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256((x), (y)), (z))
+
+/* Compress one PBKDF2 iteration block in every lane: state words A..H of each lane in start, message words
+ * W0..W7 in words and the loop-invariant padding of a 32-byte message after the 64-byte key block. */
+__attribute__((target("avx2"))) static inline void
+sha256_x8_compress(const __m256i start[8], const __m256i words[8], __m256i out[8])
+{
+    __m256i w[16];
+    for (int t = 0; t < 8; t++)
+        w[t] = words[t];
+    w[8] = _mm256_set1_epi32((int) 0x80000000);
+    for (int t = 9; t < 15; t++)
+        w[t] = _mm256_setzero_si256();
+    w[15] = _mm256_set1_epi32((SHA256_CBLOCK + SHA256_DIGEST_LENGTH) * 8);
+
+    __m256i a = start[0], b = start[1], c = start[2], d = start[3];
+    __m256i e = start[4], f = start[5], g = start[6], h = start[7];
+
+#pragma GCC unroll 64
+    for (int t = 0; t < 64; t++) {
+        if (t >= 16) {
+            const __m256i w15 = w[(t - 15) & 15];
+            const __m256i w2 = w[(t - 2) & 15];
+            const __m256i s0 = X8_XOR3(X8_ROTR(w15, 7), X8_ROTR(w15, 18), _mm256_srli_epi32(w15, 3));
+            const __m256i s1 = X8_XOR3(X8_ROTR(w2, 17), X8_ROTR(w2, 19), _mm256_srli_epi32(w2, 10));
+            const __m256i w7 = w[(t - 7) & 15];
+            w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w7, s1));
+        }
+
+        const __m256i sum1 = X8_XOR3(X8_ROTR(e, 6), X8_ROTR(e, 11), X8_ROTR(e, 25));
+        const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        const __m256i kw = _mm256_add_epi32(_mm256_set1_epi32((int) sha256_k[t]), w[t & 15]);
+        const __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, sum1), _mm256_add_epi32(ch, kw));
+        const __m256i sum0 = X8_XOR3(X8_ROTR(a, 2), X8_ROTR(a, 13), X8_ROTR(a, 22));
+        const __m256i maj =
+            _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        const __m256i t2 = _mm256_add_epi32(sum0, maj);
+
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+
+    out[0] = _mm256_add_epi32(start[0], a);
+    out[1] = _mm256_add_epi32(start[1], b);
+    out[2] = _mm256_add_epi32(start[2], c);
+    out[3] = _mm256_add_epi32(start[3], d);
+    out[4] = _mm256_add_epi32(start[4], e);
+    out[5] = _mm256_add_epi32(start[5], f);
+    out[6] = _mm256_add_epi32(start[6], g);
+    out[7] = _mm256_add_epi32(start[7], h);
+}
+
+/* Word j of every lane, one lane per 32-bit element. */
+__attribute__((target("avx2"))) static inline __m256i
+sha256_x8_gather(const uint32_t words[X8_LANES][8], int j)
+{
+    return _mm256_setr_epi32((int) words[0][j], (int) words[1][j], (int) words[2][j], (int) words[3][j],
+                             (int) words[4][j], (int) words[5][j], (int) words[6][j], (int) words[7][j]);
+}
+
+/* PBKDF2 block function for up to 8 independent (password, salt, block counter) jobs at once.  The first
+ * iteration of each runs through OpenSSL, iterations 2..c run in lockstep with the state transposed so
+ * word j of every lane shares a register. */
+__attribute__((target("avx2"))) static void
+pbkdf2_f_sha256_x8(const uint8_t* const* pw, const size_t* npw, const uint8_t* const* salt,
+                   const size_t* nsalt, const uint32_t* counter, int lanes, uint32_t iterations,
+                   uint8_t (*out)[SHA256_DIGEST_LENGTH])
+{
+    uint32_t inner_h[X8_LANES][8];
+    uint32_t outer_h[X8_LANES][8];
+    uint32_t U_words[X8_LANES][8];
+
+    for (int l = 0; l < lanes; l++) {
+        /* First iteration:
+         *   U_1 = PRF(P, S || INT_32_BE(i))
+         */
+        HMAC_CTX(sha256) ctx;
+        HMAC_INIT(sha256)(&ctx, pw[l], npw[l]);
+        memcpy(inner_h[l], ctx.inner.h, sizeof inner_h[l]);
+        memcpy(outer_h[l], ctx.outer.h, sizeof outer_h[l]);
+
+        uint8_t countbuf[4];
+        uint8_t Ublock[SHA256_DIGEST_LENGTH];
+        write32_be(counter[l], countbuf);
+        HMAC_UPDATE(sha256)(&ctx, salt[l], nsalt[l]);
+        HMAC_UPDATE(sha256)(&ctx, countbuf, sizeof countbuf);
+        HMAC_FINAL(sha256)(&ctx, Ublock);
+        for (int j = 0; j < 8; j++)
+            U_words[l][j] = ((uint32_t) Ublock[4 * j] << 24) | ((uint32_t) Ublock[4 * j + 1] << 16) |
+                            ((uint32_t) Ublock[4 * j + 2] << 8) | Ublock[4 * j + 3];
+    }
+
+    /* Unused lanes repeat the first job */
+    for (int l = lanes; l < X8_LANES; l++) {
+        memcpy(inner_h[l], inner_h[0], sizeof inner_h[l]);
+        memcpy(outer_h[l], outer_h[0], sizeof outer_h[l]);
+        memcpy(U_words[l], U_words[0], sizeof U_words[l]);
+    }
+
+    __m256i inner[8], outer[8], U[8], result[8];
+    for (int j = 0; j < 8; j++) {
+        inner[j] = sha256_x8_gather(inner_h, j);
+        outer[j] = sha256_x8_gather(outer_h, j);
+        U[j] = result[j] = sha256_x8_gather(U_words, j);
+    }
+
+    /* Subsequent iterations:
+     *   U_c = PRF(P, U_{c-1})
+     */
+    for (uint32_t i = 1; i < iterations; i++) {
+        sha256_x8_compress(inner, U, U);
+        sha256_x8_compress(outer, U, U);
+        for (int j = 0; j < 8; j++)
+            result[j] = _mm256_xor_si256(result[j], U[j]);
+    }
+
+    uint32_t result_words[8][X8_LANES];
+    for (int j = 0; j < 8; j++)
+        _mm256_storeu_si256((__m256i*) result_words[j], result[j]);
+    _mm256_zeroupper();
+
+    for (int l = 0; l < lanes; l++)
+        for (int j = 0; j < 8; j++)
+            write32_be(result_words[j][l], out[l] + 4 * j);
+}
+
+#endif
+
+/* --- Lane scheduling shared by the x86 paths --- */
+#if defined(WITH_SHA_NI) || defined(WITH_AVX2)
+#define MAX_LANES 8
+
+/* Block function running iterations of up to max_lanes (password, salt, block counter) jobs together. */
+typedef void (*pbkdf2_lanes_f)(const uint8_t* const* pw, const size_t* npw, const uint8_t* const* salt,
+                               const size_t* nsalt, const uint32_t* counter, int lanes, uint32_t iterations,
+                               uint8_t (*out)[SHA256_DIGEST_LENGTH]);
+
+/* Spread every output block of every derivation over the lanes of f, max_lanes jobs at a time. */
+static void pbkdf2_sha256_lanes(pbkdf2_lanes_f f, int max_lanes, const uint8_t* const* pw, const size_t* npw,
+                                const uint8_t* const* salt, const size_t* nsalt, uint32_t iterations,
+                                uint8_t* const* out, size_t nout, size_t n)
+{
+    assert(iterations);
+    assert(out && nout);
+    assert(max_lanes <= MAX_LANES);
+
+    /* How many blocks do we need? */
+    const size_t blocks_needed = (nout + SHA256_DIGEST_LENGTH - 1) / SHA256_DIGEST_LENGTH;
+    const size_t jobs = n * blocks_needed;
+
+    for (size_t first = 0; first < jobs; first += max_lanes) {
+        const int lanes = (int) MIN(jobs - first, (size_t) max_lanes);
+        const uint8_t* lane_pw[MAX_LANES];
+        const uint8_t* lane_salt[MAX_LANES];
+        size_t lane_npw[MAX_LANES];
+        size_t lane_nsalt[MAX_LANES];
+        uint32_t lane_counter[MAX_LANES];
+        uint8_t blocks[MAX_LANES][SHA256_DIGEST_LENGTH];
+
+        for (int l = 0; l < lanes; l++) {
+            const size_t i = (first + l) / blocks_needed;
+            lane_pw[l] = pw[i];
+            lane_npw[l] = npw[i];
+            lane_salt[l] = salt[i];
+            lane_nsalt[l] = nsalt[i];
+            lane_counter[l] = (uint32_t)((first + l) % blocks_needed) + 1;
+        }
+
+        f(lane_pw, lane_npw, lane_salt, lane_nsalt, lane_counter, lanes, iterations, blocks);
+
+        for (int l = 0; l < lanes; l++) {
+            const size_t offset = (lane_counter[l] - 1) * SHA256_DIGEST_LENGTH;
+            const size_t taken = MIN(nout - offset, SHA256_DIGEST_LENGTH);
+            memcpy(out[(first + l) / blocks_needed] + offset, blocks[l], taken);
+        }
+    }
+}
+#endif
+
 static inline void sha512_extract(SHA512_CTX* restrict ctx, uint8_t* restrict out)
 {
     write64_be(ctx->h[0], out);
@@ -327,12 +692,59 @@ void fastpbkdf2_hmac_sha1(const uint8_t* pw, size_t npw, const uint8_t* salt, si
     PBKDF2(sha1)(pw, npw, salt, nsalt, iterations, out, nout);
 }
 
+void fastpbkdf2_sha256_hide_features(unsigned features) { hidden_features = features; }
+
+fastpbkdf2_sha256_impl fastpbkdf2_sha256_select(size_t jobs)
+{
+#ifdef WITH_SHA_NI
+    if (sha_ni_supported())
+        return FASTPBKDF2_SHA256_SHA_NI;
+#endif
+#ifdef WITH_AVX2
+    /* Below a few jobs the scalar rounds of one chain beat paying for all eight lanes */
+    if (avx2_supported() && jobs >= X8_MIN_JOBS)
+        return FASTPBKDF2_SHA256_AVX2_X8;
+#endif
+    (void) jobs;
+    return FASTPBKDF2_SHA256_OPENSSL;
+}
+
 void fastpbkdf2_hmac_sha256(const uint8_t* pw, size_t npw, const uint8_t* salt, size_t nsalt,
                             uint32_t iterations, uint8_t* out, size_t nout)
 {
+#ifdef WITH_SHA_NI
+    if (fastpbkdf2_sha256_select(1) == FASTPBKDF2_SHA256_SHA_NI) {
+        pbkdf2_sha256_lanes(pbkdf2_f_sha256_ni, NI_LANES, &pw, &npw, &salt, &nsalt, iterations, &out, nout,
+                            1);
+        return;
+    }
+#endif
     PBKDF2(sha256)(pw, npw, salt, nsalt, iterations, out, nout);
 }
 
+void fastpbkdf2_hmac_sha256_multi(const uint8_t* const* pw, const size_t* npw, const uint8_t* const* salt,
+                                  const size_t* nsalt, uint32_t iterations, uint8_t* const* out, size_t nout,
+                                  size_t n)
+{
+    const size_t jobs = n * ((nout + SHA256_DIGEST_LENGTH - 1) / SHA256_DIGEST_LENGTH);
+    switch (fastpbkdf2_sha256_select(jobs)) {
+#ifdef WITH_SHA_NI
+    case FASTPBKDF2_SHA256_SHA_NI:
+        pbkdf2_sha256_lanes(pbkdf2_f_sha256_ni, NI_LANES, pw, npw, salt, nsalt, iterations, out, nout, n);
+        return;
+#endif
+#ifdef WITH_AVX2
+    case FASTPBKDF2_SHA256_AVX2_X8:
+        pbkdf2_sha256_lanes(pbkdf2_f_sha256_x8, X8_LANES, pw, npw, salt, nsalt, iterations, out, nout, n);
+        return;
+#endif
+    default:
+        break;
+    }
+    for (size_t i = 0; i < n; i++)
+        fastpbkdf2_hmac_sha256(pw[i], npw[i], salt[i], nsalt[i], iterations, out[i], nout);
+}
+
 void fastpbkdf2_hmac_sha512(const uint8_t* pw, size_t npw, const uint8_t* salt, size_t nsalt,
                             uint32_t iterations, uint8_t* out, size_t nout)
 {
@@ -47,6 +47,47 @@ void fastpbkdf2_hmac_sha1(const uint8_t* pw, size_t npw, const uint8_t* salt, si
 void fastpbkdf2_hmac_sha256(const uint8_t* pw, size_t npw, const uint8_t* salt, size_t nsalt,
                             uint32_t iterations, uint8_t* out, size_t nout);
 
+/** CPU features the SHA-256 functions dispatch on, for fastpbkdf2_sha256_hide_features. */
+#define FASTPBKDF2_SHA_NI 1u
+#define FASTPBKDF2_AVX2 2u
+
+/** Implementations the SHA-256 functions choose from at run time. */
+typedef enum {
+    FASTPBKDF2_SHA256_OPENSSL, /* one chain at a time over OpenSSL's SHA256_Transform */
+    FASTPBKDF2_SHA256_SHA_NI,  /* up to four chains interleaved on the x86 SHA extensions */
+    FASTPBKDF2_SHA256_AVX2_X8  /* eight chains in the 32-bit lanes of AVX2 registers */
+} fastpbkdf2_sha256_impl;
+
+/** Makes the SHA-256 functions act as if the CPU lacked @p features, a
+ *  mask of FASTPBKDF2_SHA_NI and FASTPBKDF2_AVX2, 0 to use all it has.
+ *
+ *  Lets every implementation be tested on one host.  Not thread safe
+ *  against derivations running at the same time.
+ */
+void fastpbkdf2_sha256_hide_features(unsigned features);
+
+/** Returns the implementation a SHA-256 derivation of @p jobs 32-byte
+ *  output blocks in total, over all inputs, runs on.
+ */
+fastpbkdf2_sha256_impl fastpbkdf2_sha256_select(size_t jobs);
+
+/** Calculates PBKDF2-HMAC-SHA256 for @p n independent inputs at once.
+ *
+ *  For each i < @p n, @p npw[i] bytes at @p pw[i] are the password input,
+ *  @p nsalt[i] bytes at @p salt[i] are the salt input and @p nout bytes of
+ *  output are written to @p out[i], as fastpbkdf2_hmac_sha256 would.
+ *  @p iterations is the PBKDF2 iteration count and must be non-zero.
+ *
+ *  Derivations run side by side in SIMD lanes where the CPU supports it, so
+ *  throughput grows with vector width while each one still takes the time of
+ *  a single derivation.
+ *
+ *  This function cannot fail; it does not report errors.
+ */
+void fastpbkdf2_hmac_sha256_multi(const uint8_t* const* pw, const size_t* npw, const uint8_t* const* salt,
+                                  const size_t* nsalt, uint32_t iterations, uint8_t* const* out, size_t nout,
+                                  size_t n);
+
 /** Calculates PBKDF2-HMAC-SHA512.
  *
  *  @p npw bytes at @p pw are the password input.
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <algorithm>
-#include <climits>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <exception>
@@ -17,8 +17,6 @@
 
 #include "../../obfuscate.h"
 
-using random_bytes_engine = independent_bits_engine<default_random_engine, CHAR_BIT, u8>;
-
 /// Authenticated Encryption with Additional Data
 template<class T> class AEAD
 {
@@ -34,23 +32,29 @@ template<class T> class AEAD
             cerr << error << KEY_GENERATING_KEY.size() << ".\n";
             exit(1);
         }
+
+        // Expand key generating key once for all key derivations
+        key_generator.set_key(KEY_GENERATING_KEY);
     }
 
+    /// Bytes in front of the plaintext reserved for the nonce in in-place buffers
+    size_t headroom() const { return NONCE_BYTE_LEN; }
+
+    /// Bytes past the plaintext reserved for padding and the tag in in-place buffers
+    size_t tailroom() const { return TAG_BYTE_LEN; }
+
     /**
      * Encrypt message with prepended nonce/appended tag
      * @param plaintext: plaintext to encrypt
      * @param aad: additional authenticated data
      */
-    void seal(vector<u8>& plaintext, vector<u8>& aad, bool parallel = true)
+    void seal(vector<u8>& plaintext, const vector<u8>& aad, bool parallel = true)
     {
-        // Generate random nonce -- completely disallow misuse
-        vector<u8> nonce(NONCE_BYTE_LEN);
-        random_bytes_engine rbe;
-        generate(begin(nonce), end(nonce), ref(rbe));
-        // Encrypt
-        seal(plaintext, aad, nonce, parallel);
-        // Insert nonce into beginning of  plaintext
-        plaintext.insert(plaintext.begin(), nonce.begin(), nonce.end());
+        // Make room for nonce/tag with a single move of the plaintext
+        const size_t plaintext_len = plaintext.size();
+        plaintext.resize(headroom() + plaintext_len + tailroom());
+        memmove(plaintext.data() + headroom(), plaintext.data(), plaintext_len);
+        plaintext.resize(seal(plaintext.data(), plaintext_len, aad, parallel));
     }
 
     /**
@@ -58,98 +62,314 @@ template<class T> class AEAD
      * @param ciphertext: ciphertext to decrypt
      * @param aad: additional authenticated data
      */
-    void open(vector<u8>& ciphertext, vector<u8>& aad, bool parallel = true)
+    void open(vector<u8>& ciphertext, const vector<u8>& aad, bool parallel = true)
+    {
+        const size_t plaintext_len = open(ciphertext.data(), ciphertext.size(), aad, parallel);
+        // Drop nonce with a single move of the plaintext
+        ciphertext.resize(headroom() + plaintext_len);
+        ciphertext.erase(ciphertext.begin(), ciphertext.begin() + headroom());
+    }
+
+    /**
+     * Encrypt message in place, writing the nonce into the headroom and the tag into the tailroom
+     * @param buffer: headroom() bytes, then the plaintext, then tailroom() bytes of spare capacity
+     * @param plaintext_len: plaintext byte length
+     * @param aad: additional authenticated data
+     * @return length of nonce || ciphertext || tag from the start of buffer
+     */
+    size_t seal(u8* buffer, size_t plaintext_len, const vector<u8>& aad, bool parallel = true)
     {
-        size_t ciphertext_size = ciphertext.size();
+        // Generate random nonce -- completely disallow misuse
+        random_nonce_bytes(buffer, NONCE_BYTE_LEN);
+        return NONCE_BYTE_LEN + seal(buffer + NONCE_BYTE_LEN, plaintext_len, aad, buffer, parallel);
+    }
 
+    /**
+     * Decrypt/authenticate message in place, leaving the plaintext at buffer + headroom()
+     * @param buffer: nonce || ciphertext || tag
+     * @param len: byte length of buffer
+     * @param aad: additional authenticated data
+     * @return plaintext length
+     */
+    size_t open(u8* buffer, size_t len, const vector<u8>& aad, bool parallel = true)
+    {
         // TODO: Test
-        if (ciphertext.size() < NONCE_BYTE_LEN) {
+        if (len < NONCE_BYTE_LEN) {
             string error = "ERROR: Ciphertext to be at least the 96 bytes (nonce size), got "_hidden;
-            cerr << error << ciphertext_size << "\n";
+            cerr << error << len << "\n";
             exit(1);
         }
 
-        // Retrieve nonce
-        const vector<u8> nonce(ciphertext.begin(), ciphertext.begin() + NONCE_BYTE_LEN);
-        // Remove nonce from ciphertext
-        ciphertext = vector<u8>(ciphertext.begin() + NONCE_BYTE_LEN, ciphertext.end());
-        open(ciphertext, aad, nonce, parallel);
+        return open(buffer + NONCE_BYTE_LEN, len - NONCE_BYTE_LEN, aad, buffer, parallel);
+    }
+
+    /**
+     * Encrypt many messages, each with prepended nonce/appended tag like seal
+     * Messages are handled in groups whose key derivation, tag encryption and CTR keystream each take one
+     * cipher call across all their keys, so short messages still fill the multi-block path
+     * @param plaintexts: messages to encrypt in place
+     * @param aads: additional authenticated data of each message
+     * @param parallel: spread groups over the thread pool
+     */
+    void seal(vector<vector<u8>>& plaintexts, const vector<vector<u8>>& aads, bool parallel = true)
+    {
+        validate(plaintexts, aads);
+
+        // Distinct nonces for every message of the batch
+        vector<u8> nonces(plaintexts.size() * NONCE_BYTE_LEN);
+        random_nonce_bytes(nonces.data(), nonces.size());
+
+        for_each_group(plaintexts.size(), parallel, [&](size_t begin, size_t end) {
+            seal_group(plaintexts, aads, nonces.data(), begin, end);
+        });
+    }
+
+    /**
+     * Decrypt/authenticate many messages sealed with seal, in groups like the batch seal
+     * Every message is processed, ones failing authentication are wiped before the call throws
+     * @param ciphertexts: messages to decrypt in place
+     * @param aads: additional authenticated data of each message
+     * @param parallel: spread groups over the thread pool
+     */
+    void open(vector<vector<u8>>& ciphertexts, const vector<vector<u8>>& aads, bool parallel = true)
+    {
+        validate(ciphertexts, aads);
+
+        atomic<bool> failed{false};
+        for_each_group(ciphertexts.size(), parallel, [&](size_t begin, size_t end) {
+            if (!open_group(ciphertexts, aads, begin, end))
+                failed = true;
+        });
+
+        if (failed) {
+            string msg = "AEAD authentication failed"_hidden;
+            throw runtime_error(msg);
+        }
     }
 
 #ifndef DEBUG
   private:
 #endif
+    /// Seals/opens segments with derived nonces
+    template<class U> friend class StreamAEAD;
 
     const size_t NONCE_BYTE_LEN = 96 / 8;
-    const size_t BLOCK_BYTE_LEN = block_byte_size<T>();
+    static constexpr size_t BLOCK_BYTE_LEN = block_byte_size<T>();
+    /// Tag is one cipher block, which also covers the padding of the last block
+    static constexpr size_t TAG_BYTE_LEN = BLOCK_BYTE_LEN;
+    /// Blocks decrypted and hashed together by open, 16KB of RC6-128 to stay in L1 between the two
+    static const size_t TILE_BLOCKS = 1024;
+    /// Fewest tiles handed to a thread by a parallel open
+    static const size_t PARALLEL_MIN_TILES = 4;
+    /// Messages of a batch sharing key derivation, tag and CTR cipher calls
+    static const size_t BATCH_GROUP = 64;
+    /// Keystream blocks per multi-key cipher call of a batch
+    static const size_t KEYSTREAM_BLOCKS = 256;
     /// 64GB data limit for GCM-SIV
     const double MAX_DATA_SIZE = pow(2, 36);
     const vector<u8>& KEY_GENERATING_KEY;
+    /// Cipher keyed with the key generating key
+    RC6<T> key_generator;
 
     /**
      * Calculate tag for authentication
-     * @param message_encryption_key: vector to store message encryption key in
-     * @param message_authentication_key: vector to store message authentication key in
-     * @param plaintext: plaintext message
-     * @param aad: authenticated additional data
+     * @param ecb: ECB cipher keyed with the message encryption key
+     * @param message_authentication_key: message authentication key
+     * @param plaintext: block-aligned plaintext message
+     * @param plaintext_len: padded plaintext byte length
+     * @param aad: authenticated additional data, zero-padded to the block size while hashing
+     * @param nonce: nonce
+     * @param tag: TAG_BYTE_LEN bytes to store the tag in
+     * @param parallel: hash large plaintexts across the pool
+     */
+    void get_tag(ECB<RC6<T>>& ecb, const vector<u8>& message_authentication_key, const u8* plaintext,
+                 size_t plaintext_len, const vector<u8>& aad, const u8* nonce, u8* tag, bool parallel)
+    {
+        Polyval<T> authenticator = Polyval<T>(message_authentication_key);
+        hash_aad(authenticator, aad, parallel);
+        parallel ? authenticator.update_parallel(plaintext, plaintext_len)
+                 : authenticator.update(plaintext, plaintext_len);
+        finish_tag(ecb, authenticator, aad.size(), plaintext_len, nonce, tag);
+    }
+
+    /**
+     * Hash the AAD, zero-padded to the block size, as the start of a digest
+     * The authentication key changes with every nonce and the digest is a polynomial in it, so the AAD is
+     * evaluated afresh per message; a long AAD shared by every message is instead spread over the pool
+     * @param authenticator: Polyval keyed with the message authentication key
+     * @param aad: additional authenticated data
+     * @param parallel: hash large AADs across the pool
+     */
+    void hash_aad(Polyval<T>& authenticator, const vector<u8>& aad, bool parallel)
+    {
+        // An empty AAD is hashed as one zero block, like padding_len counts it
+        if (aad.empty()) {
+            const u8 zero_block[BLOCK_BYTE_LEN] = {};
+            authenticator.update(zero_block, BLOCK_BYTE_LEN);
+            return;
+        }
+
+        parallel ? authenticator.update_parallel(aad.data(), aad.size())
+                 : authenticator.update(aad.data(), aad.size());
+    }
+
+    /**
+     * Hash the length block into a digest of AAD and plaintext and turn it into the tag
+     * @param ecb: ECB cipher keyed with the message encryption key
+     * @param authenticator: Polyval that has hashed the AAD and padded plaintext
+     * @param aad_len: unpadded AAD byte length
+     * @param plaintext_len: padded plaintext byte length
+     * @param nonce: nonce
+     * @param tag: TAG_BYTE_LEN bytes to store the tag in
+     */
+    void finish_tag(ECB<RC6<T>>& ecb, Polyval<T>& authenticator, size_t aad_len, size_t plaintext_len,
+                    const u8* nonce, u8* tag)
+    {
+        tag_block(authenticator, aad_len, plaintext_len, nonce, tag);
+        ecb.encrypt(tag, TAG_BYTE_LEN);
+    }
+
+    /**
+     * Hash the length block into a digest of AAD and plaintext, giving the block encrypted into the tag
+     * @param authenticator: Polyval that has hashed the AAD and padded plaintext
+     * @param aad_len: unpadded AAD byte length
+     * @param plaintext_len: padded plaintext byte length
      * @param nonce: nonce
+     * @param block: TAG_BYTE_LEN bytes to store the unencrypted tag in
      */
-    vector<u8> get_tag(const vector<u8>& message_encryption_key, const vector<u8>& message_authentication_key,
-                       const vector<u8>& plaintext, const vector<u8>& aad, const vector<u8>& nonce)
+    void tag_block(Polyval<T>& authenticator, size_t aad_len, size_t plaintext_len, const u8* nonce,
+                   u8* block)
     {
         // Create length block
         vector<u8> length_block(BLOCK_BYTE_LEN);
-        u64 aad_bit_len = aad.size() * 8;
-        u64 plaintext_bit_len = plaintext.size() * 8;
+        u64 aad_bit_len = (aad_len + padding_len(aad_len)) * 8;
+        u64 plaintext_bit_len = plaintext_len * 8;
         in_place_update(length_block, !is_big_endian() ? aad_bit_len : swap_endian(aad_bit_len), 0);
         in_place_update(length_block, !is_big_endian() ? plaintext_bit_len : swap_endian(plaintext_bit_len),
                         8);
 
         // Digest
-        Polyval<T> authenticator = Polyval<T>(message_authentication_key);
-        authenticator.update(aad);
-        authenticator.update(plaintext);
         authenticator.update(length_block);
         vector<u8> digest = authenticator.digest();
 
         // XOR first 96 bytes of digest with nonce
-        for (size_t i = 0; i < nonce.size(); i++)
+        for (size_t i = 0; i < NONCE_BYTE_LEN; i++)
             digest[i] ^= nonce[i];
 
         digest[digest.size() - 1] &= ~0x80;
 
-        // Encrypt digest
-        RC6<T> cipher{};
-        // TODO: I remember a fancy way to instanciate a template parameter in the
-        //       inheriting class
-        ECB<RC6<T>> ecb(cipher);
-        ecb.encrypt(digest, message_encryption_key);
+        digest.resize(TAG_BYTE_LEN);
+        copy(digest.begin(), digest.end(), block);
+    }
 
-        return digest;
+    /**
+     * Decrypt and hash in a single pass over cache-sized tiles, hashing each tile while it is still in cache
+     * Tiles are spread over the pool from a zero Polyval state each and chained with powers of H afterwards
+     * @param ecb: ECB cipher keyed with the message encryption key
+     * @param authenticator: Polyval that has hashed the AAD, continued with the plaintext
+     * @param ciphertext: ciphertext to decrypt in place
+     * @param ciphertext_len: unpadded ciphertext byte length
+     * @param padded_len: ciphertext byte length padded to the block size
+     * @param tag: tag to use as counter
+     */
+    void decrypt_and_hash(ECB<RC6<T>>& ecb, Polyval<T>& authenticator, u8* ciphertext, size_t ciphertext_len,
+                          size_t padded_len, const u8* tag, bool parallel)
+    {
+        vector<u8> counter(BLOCK_BYTE_LEN);
+        CTR<ECB<RC6<T>>>::init_counter(counter.data(), tag, BLOCK_BYTE_LEN);
+
+        const size_t tile_size = TILE_BLOCKS * BLOCK_BYTE_LEN;
+        const size_t tiles = (padded_len + tile_size - 1) / tile_size;
+        // Tiles share one multiplier table or set of powers of H, built once per message
+        if (tiles > 1)
+            authenticator.prepare_multiplier();
+        vector<Polyval<T>> partials(tiles, authenticator);
+
+        auto process_tiles = [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                const size_t offset = t * tile_size;
+                const size_t len = min(tile_size, padded_len - offset);
+                CTR<ECB<RC6<T>>>::crypt_range(ciphertext, counter.data(), BLOCK_BYTE_LEN, ecb, offset,
+                                              offset + len);
+
+                // Replace padded portion of decrypted text with zeroes for tag calculation
+                if (offset + len == padded_len)
+                    fill(ciphertext + ciphertext_len, ciphertext + padded_len, 0);
+
+                partials[t].reset();
+                partials[t].update(ciphertext + offset, len);
+            }
+        };
+        if (parallel)
+            parallel::for_each_range(tiles, PARALLEL_MIN_TILES, process_tiles);
+        else
+            process_tiles(0, tiles);
+
+        // Every tile but the last is full, so they share one power of H
+        const FieldElement64 h_tile = authenticator.h_power(TILE_BLOCKS);
+        for (size_t t = 0; t < tiles; t++) {
+            const size_t blocks = min(tile_size, padded_len - t * tile_size) / BLOCK_BYTE_LEN;
+            const FieldElement64 h_n = blocks == TILE_BLOCKS ? h_tile : authenticator.h_power(blocks);
+            authenticator.combine(partials[t], h_n);
+        }
     }
 
     /**
-     * Encrypt key counter block
-     * @param rc6: cipher instance TODO: use abstract cipher interface
-     * @param ctr_block: counter block
-     * @param key_ctr: key counter
-     * @param nonce: nonce
+     * Fill nonce bytes straight from random_device, the one nonce source of every seal
+     * A default-seeded engine would hand every process the same sequence of nonces
+     * @param bytes: storage for the nonce bytes
+     * @param len: byte length
      */
-    void encrypt_key_ctr_block(RC6<T>& rc6, vector<u8>& ctr_block, u32 key_ctr, const vector<u8>& nonce)
+    static void random_nonce_bytes(u8* bytes, size_t len)
     {
-        u8* byte_arr = (u8*) &key_ctr;
+        random_device rd;
+        generate(bytes, bytes + len, [&rd] { return (u8) rd(); });
+    }
 
-        if (is_big_endian()) {
-            T* word_arr = (T*) &key_ctr;
-            for (size_t i = 0; i < sizeof(*word_arr) / sizeof(T); i++)
-                word_arr[i] = swap_endian(word_arr[i]);
-        }
+    /// Key counter blocks per nonce: 2 for the authentication key, 2 or 4 for the encryption key
+    size_t key_blocks() const { return KEY_GENERATING_KEY.size() == 32 ? 6 : 4; }
 
-        ctr_block.insert(ctr_block.end(), byte_arr, byte_arr + sizeof(T));
+    /**
+     * Write the key counter blocks for a nonce, little endian counter followed by the nonce
+     * @param blocks: key_blocks() blocks to store the counter blocks in
+     * @param nonce: nonce
+     */
+    void key_ctr_blocks(u8* blocks, const u8* nonce)
+    {
+        for (u32 key_ctr = 0; key_ctr < key_blocks(); key_ctr++) {
+            u8* block = blocks + key_ctr * BLOCK_BYTE_LEN;
+            fill(block, block + BLOCK_BYTE_LEN, 0);
+            for (size_t k = 0; k < sizeof(key_ctr); k++)
+                block[k] = (u8)(key_ctr >> (8 * k));
+            copy(nonce, nonce + NONCE_BYTE_LEN, block + sizeof(T));
+        }
+    }
 
-        // Append nonce
-        ctr_block.insert(ctr_block.end(), nonce.begin(), nonce.end());
-        rc6.encrypt(ctr_block, KEY_GENERATING_KEY);
+    /**
+     * Derive message authentication/encryption keys for many nonces in one multi-block cipher call
+     * @param authentication_keys: storage for each nonce's message authentication key
+     * @param encryption_keys: storage for each nonce's message encryption key
+     * @param nonces: nonces
+     */
+    void derive_keys(vector<vector<u8>>& authentication_keys, vector<vector<u8>>& encryption_keys,
+                     const vector<const u8*>& nonces)
+    {
+        const size_t blocks_per_nonce = key_blocks();
+        vector<u8> ctr_blocks(nonces.size() * blocks_per_nonce * BLOCK_BYTE_LEN);
+        for (size_t i = 0; i < nonces.size(); i++)
+            key_ctr_blocks(ctr_blocks.data() + i * blocks_per_nonce * BLOCK_BYTE_LEN, nonces[i]);
+        key_generator.encrypt_blocks(ctr_blocks.data(), nonces.size() * blocks_per_nonce);
+
+        // First half of each encrypted counter block is key material
+        authentication_keys.assign(nonces.size(), vector<u8>());
+        encryption_keys.assign(nonces.size(), vector<u8>());
+        for (size_t i = 0; i < nonces.size(); i++) {
+            for (size_t key_ctr = 0; key_ctr < blocks_per_nonce; key_ctr++) {
+                const u8* block = ctr_blocks.data() + (i * blocks_per_nonce + key_ctr) * BLOCK_BYTE_LEN;
+                vector<u8>& key = key_ctr < 2 ? authentication_keys[i] : encryption_keys[i];
+                key.insert(key.end(), block, block + 8);
+            }
+        }
     }
 
     /**
@@ -161,55 +381,36 @@ template<class T> class AEAD
      * @param nonce: nonce
      */
     void derive_keys(vector<u8>& message_authentication_key, vector<u8>& message_encryption_key,
-                     const vector<u8>& nonce)
+                     const u8* nonce)
     {
-        RC6<T> rc6 = RC6<T>();
-        u32 key_ctr;
-
-        // 128-bit key key generating key
-        for (key_ctr = 0; key_ctr < 4; key_ctr++) {
-            vector<u8> ctr_block;
-            encrypt_key_ctr_block(rc6, ctr_block, key_ctr, nonce);
-
-            for (size_t j = 0; j < 8; j++) {
-                if (key_ctr < 2)
-                    message_authentication_key.push_back(ctr_block[j]);
-                else if (key_ctr >= 2)
-                    message_encryption_key.push_back(ctr_block[j]);
-            }
-        }
-
-        // 256-bit key generating key
-        if (KEY_GENERATING_KEY.size() == 32) {
-            for (key_ctr = 4; key_ctr < 6; key_ctr++) {
-                vector<u8> ctr_block;
-                encrypt_key_ctr_block(rc6, ctr_block, key_ctr, nonce);
-
-                for (size_t j = 0; j < 8; j++)
-                    message_encryption_key.push_back(ctr_block[j]);
-            }
-        }
+        vector<vector<u8>> authentication_keys;
+        vector<vector<u8>> encryption_keys;
+        derive_keys(authentication_keys, encryption_keys, {nonce});
+        message_authentication_key.swap(authentication_keys[0]);
+        message_encryption_key.swap(encryption_keys[0]);
     }
 
     /**
-     * Validate nonce, plaintext and additional authenticated data
+     * Validate nonce size
      * @param nonce
-     * @param plaintext
-     * @param aad: additional authenticated data
      */
-    void validate(const vector<u8>& nonce, const vector<u8>& plaintext, const vector<u8>& aad)
+    void validate(const vector<u8>& nonce)
     {
-        // Validate nonce size
         size_t nonce_size = nonce.size();
         if (nonce_size != NONCE_BYTE_LEN) {
             string error = "ERROR: Nonce must be 96-bits, got "_hidden;
             cerr << error << nonce_size << ".\n";
             exit(1);
         }
+    }
 
-        // Validate data is < 64GB for plaintext and AAD
-        u64 plaintext_size = plaintext.size();
-        u64 aad_size = aad.size();
+    /**
+     * Validate data is < 64GB for plaintext and AAD
+     * @param plaintext_size: plaintext byte length
+     * @param aad_size: additional authenticated data byte length
+     */
+    void validate(u64 plaintext_size, u64 aad_size)
+    {
         if (plaintext_size > MAX_DATA_SIZE) {
             string error = "ERROR: Plaintext must be < 64GB, got "_hidden;
             cerr << error << plaintext_size << ".\n";
@@ -221,18 +422,10 @@ template<class T> class AEAD
         }
     }
 
-    /**
-     * Remove padding and append tag
-     * @param ciphertext
-     * @param pad_len: number of padded bytes
-     * @param tag
-     */
-    void trim_padding_append_tag(vector<u8>& ciphertext, size_t pad_len, const vector<u8>& tag)
+    /// Number of zero bytes padding len to the block size, an empty input pads to one whole zero block
+    size_t padding_len(size_t len) const
     {
-        // Snip padding length
-        ciphertext.erase(ciphertext.end() - pad_len, ciphertext.end());
-        // Append tag
-        ciphertext.insert(ciphertext.end(), tag.begin(), tag.end());
+        return len ? (BLOCK_BYTE_LEN - len % BLOCK_BYTE_LEN) % BLOCK_BYTE_LEN : BLOCK_BYTE_LEN;
     }
 
     /**
@@ -241,58 +434,65 @@ template<class T> class AEAD
      * @param aad: additional authenticated data
      * @param nonce: user-provided nonce
      */
-    void seal(vector<u8>& plaintext, vector<u8>& aad, const vector<u8>& nonce, bool parallel = true)
+    void seal(vector<u8>& plaintext, const vector<u8>& aad, const vector<u8>& nonce, bool parallel = true)
+    {
+        validate(nonce);
+        const size_t plaintext_len = plaintext.size();
+        plaintext.resize(plaintext_len + tailroom());
+        plaintext.resize(seal(plaintext.data(), plaintext_len, aad, nonce.data(), parallel));
+    }
+
+    /**
+     * Encrypt message in place and append tag
+     * @param plaintext: plaintext to encrypt, followed by tailroom() bytes of spare capacity
+     * @param plaintext_len: plaintext byte length
+     * @param aad: additional authenticated data
+     * @param nonce: NONCE_BYTE_LEN byte nonce
+     * @return length of ciphertext || tag
+     */
+    size_t seal(u8* plaintext, size_t plaintext_len, const vector<u8>& aad, const u8* nonce, bool parallel)
     {
-        validate(nonce, plaintext, aad);
+        validate(plaintext_len, aad.size());
 
         // Derive keys
         vector<u8> authentication_key;
         vector<u8> encryption_key;
         derive_keys(authentication_key, encryption_key, nonce);
 
-        // Pad plaintext/AAD
-        size_t pad_len = pad_to_block_size(plaintext, BLOCK_BYTE_LEN);
-        pad_to_block_size(aad, BLOCK_BYTE_LEN);
+        // Pad plaintext into the tailroom
+        const size_t padded_len = plaintext_len + padding_len(plaintext_len);
+        fill(plaintext + plaintext_len, plaintext + padded_len, 0);
+
+        // Expand message encryption key once for tag and CTR
+        RC6<T> cipher(encryption_key);
+        ECB<RC6<T>> ecb(cipher);
 
         // Calculate tag
-        vector<u8> tag = get_tag(encryption_key, authentication_key, plaintext, aad, nonce);
+        vector<u8> tag(TAG_BYTE_LEN);
+        get_tag(ecb, authentication_key, plaintext, padded_len, aad, nonce, tag.data(), parallel);
 
         // Encrypt
-        RC6<T> cipher{};
-        ECB<RC6<T>> ecb(cipher);
         CTR<ECB<RC6<T>>> ctr(ecb, BLOCK_BYTE_LEN);
-        parallel ? ctr.crypt_parallel(plaintext, encryption_key, tag)
-                 : ctr.crypt(plaintext, encryption_key, tag);
+        parallel ? ctr.crypt_parallel(plaintext, padded_len, tag.data())
+                 : ctr.crypt(plaintext, padded_len, tag.data());
 
-        trim_padding_append_tag(plaintext, pad_len, tag);
+        // Tag overwrites the encrypted padding
+        copy(tag.begin(), tag.end(), plaintext + plaintext_len);
+        return plaintext_len + TAG_BYTE_LEN;
     }
 
     /**
-     * Authenticate decrypted ciphertext
-     * @param ciphertext
-     * @param encryption_key
-     * @param authentication_key
-     * @param aad: additional authenticated data
-     * @param nonce
-     * @param tag
-     * @param pad_len: number of bytes padded to blocksize
+     * Authenticate decrypted ciphertext, wiping it on failure
+     * @param plaintext: decrypted message
+     * @param plaintext_len: byte length
+     * @param actual: tag calculated over the decrypted message
+     * @param tag: tag received with the message
      */
-    void authenticate(vector<u8>& ciphertext, const vector<u8>& encryption_key,
-                      const vector<u8>& authentication_key, const vector<u8>& aad, const vector<u8>& nonce,
-                      const vector<u8>& tag, size_t pad_len)
+    void authenticate(u8* plaintext, size_t plaintext_len, const u8* actual, const u8* tag)
     {
-        // Replace padded portion of decrypted text with zeroes for tag calculation
-        for (size_t i = ciphertext.size() - pad_len; i < ciphertext.size(); i++)
-            ciphertext[i] = 0;
-
-        // Calculate tag
-        vector<u8> actual = get_tag(encryption_key, authentication_key, ciphertext, aad, nonce);
-
-        // Snip padding to original data size
-        ciphertext = vector<u8>(ciphertext.begin(), ciphertext.end() - pad_len);
-
         // Authenticate TODO: Create custom authentication exception
-        if (!equal(actual.begin(), actual.end(), tag.begin())) {
+        if (!equal(actual, actual + TAG_BYTE_LEN, tag)) {
+            fill(plaintext, plaintext + plaintext_len, 0);
             string msg = "AEAD authentication failed"_hidden;
             throw runtime_error(msg);
         }
@@ -304,30 +504,283 @@ template<class T> class AEAD
      * @param aad: additional authenticated data
      * @param nonce: nonce
      */
-    void open(vector<u8>& ciphertext, vector<u8>& aad, const vector<u8>& nonce, bool parallel)
+    void open(vector<u8>& ciphertext, const vector<u8>& aad, const vector<u8>& nonce, bool parallel)
+    {
+        validate(nonce);
+        ciphertext.resize(open(ciphertext.data(), ciphertext.size(), aad, nonce.data(), parallel));
+    }
+
+    /**
+     * Decrypt and authenticate message in place
+     * @param ciphertext: ciphertext || tag
+     * @param len: byte length of ciphertext || tag
+     * @param aad: additional authenticated data
+     * @param nonce: NONCE_BYTE_LEN byte nonce
+     * @return plaintext length
+     */
+    size_t open(u8* ciphertext, size_t len, const vector<u8>& aad, const u8* nonce, bool parallel)
     {
-        // Extract tag/ciphertext
-        vector<u8> tag(ciphertext.end() - BLOCK_BYTE_LEN, ciphertext.end());
-        ciphertext = vector<u8>(ciphertext.begin(), ciphertext.end() - BLOCK_BYTE_LEN);
+        if (len < TAG_BYTE_LEN) {
+            string msg = "AEAD authentication failed"_hidden;
+            throw runtime_error(msg);
+        }
 
-        // Pad plaintext/AAD
-        size_t pad_len = pad_to_block_size(ciphertext, BLOCK_BYTE_LEN);
-        pad_to_block_size(aad, BLOCK_BYTE_LEN);
+        // Extract tag, its space holds the padding
+        const size_t ciphertext_len = len - TAG_BYTE_LEN;
+        const vector<u8> tag(ciphertext + ciphertext_len, ciphertext + len);
+        const size_t padded_len = ciphertext_len + padding_len(ciphertext_len);
 
         // Derive keys
         vector<u8> authentication_key;
         vector<u8> encryption_key;
         derive_keys(authentication_key, encryption_key, nonce);
 
-        // Decrypt
-        RC6<T> cipher{};
+        // Decrypt and hash in one pass
+        RC6<T> cipher(encryption_key);
         ECB<RC6<T>> ecb(cipher);
-        CTR<ECB<RC6<T>>> ctr(ecb, BLOCK_BYTE_LEN);
-        parallel ? ctr.crypt_parallel(ciphertext, encryption_key, tag)
-                 : ctr.crypt(ciphertext, encryption_key, tag);
+        Polyval<T> authenticator = Polyval<T>(authentication_key);
+        hash_aad(authenticator, aad, parallel);
+        decrypt_and_hash(ecb, authenticator, ciphertext, ciphertext_len, padded_len, tag.data(), parallel);
 
         // Authenticate
-        authenticate(ciphertext, encryption_key, authentication_key, aad, nonce, tag, pad_len);
+        vector<u8> actual(TAG_BYTE_LEN);
+        finish_tag(ecb, authenticator, aad.size(), padded_len, nonce, actual.data());
+        authenticate(ciphertext, padded_len, actual.data(), tag.data());
+        return ciphertext_len;
+    }
+
+    /**
+     * Validate a batch has one AAD per message
+     * @param messages
+     * @param aads: additional authenticated data
+     */
+    void validate(const vector<vector<u8>>& messages, const vector<vector<u8>>& aads)
+    {
+        if (messages.size() != aads.size()) {
+            string error = "ERROR: Batch needs one AAD per message, got "_hidden;
+            cerr << error << aads.size() << " for " << messages.size() << ".\n";
+            exit(1);
+        }
+    }
+
+    /**
+     * Split messages into groups of BATCH_GROUP and run body on group ranges
+     * @param count: number of messages
+     * @param parallel: spread groups over the thread pool
+     * @param body: called with [begin, end) message ranges of at most BATCH_GROUP messages
+     */
+    void for_each_group(size_t count, bool parallel, const function<void(size_t, size_t)>& body)
+    {
+        auto run_groups = [&](size_t begin, size_t end) {
+            for (size_t group = begin; group < end; group++)
+                body(group * BATCH_GROUP, min((group + 1) * BATCH_GROUP, count));
+        };
+
+        const size_t groups = (count + BATCH_GROUP - 1) / BATCH_GROUP;
+        if (parallel)
+            parallel::for_each_range(groups, 1, run_groups);
+        else
+            run_groups(0, groups);
+    }
+
+    /**
+     * Expand each message encryption key into a schedule for the multi-key cipher path
+     * @param encryption_keys: message encryption keys
+     */
+    vector<T> expand_keys(const vector<vector<u8>>& encryption_keys)
+    {
+        vector<T> schedules(encryption_keys.size() * RC6<T>::SCHEDULE_LEN);
+        RC6<T> expander;
+        for (size_t i = 0; i < encryption_keys.size(); i++)
+            expander.expand_key(encryption_keys[i], schedules.data() + i * RC6<T>::SCHEDULE_LEN);
+        return schedules;
+    }
+
+    /**
+     * Encrypt one tag block per message, each under its message's schedule, in one multi-key call
+     * @param blocks: unencrypted tag blocks, one per schedule
+     * @param schedules: message key schedules from expand_keys
+     * @param count: number of messages
+     */
+    void encrypt_tags(u8* blocks, const vector<T>& schedules, size_t count)
+    {
+        vector<u32> offsets(count);
+        for (size_t i = 0; i < count; i++)
+            offsets[i] = i * RC6<T>::SCHEDULE_LEN;
+        RC6<T>::encrypt_blocks(blocks, count, schedules.data(), offsets.data());
+    }
+
+    /**
+     * CTR-crypt block-aligned messages in place, each under its own schedule and tag
+     * Keystream blocks of different messages are generated together, KEYSTREAM_BLOCKS per cipher call
+     * @param messages: block-aligned messages
+     * @param lens: padded byte length of each message
+     * @param tags: tag of each message, TAG_BYTE_LEN bytes apart
+     * @param schedules: message key schedules from expand_keys
+     */
+    void crypt_batch(const vector<u8*>& messages, const vector<size_t>& lens, const u8* tags,
+                     const vector<T>& schedules)
+    {
+        vector<u8> keystream(KEYSTREAM_BLOCKS * BLOCK_BYTE_LEN);
+        vector<u32> offsets(KEYSTREAM_BLOCKS);
+        vector<u8*> targets(KEYSTREAM_BLOCKS);
+        vector<u8> counter(BLOCK_BYTE_LEN);
+        size_t filled = 0;
+
+        auto flush = [&] {
+            RC6<T>::encrypt_blocks(keystream.data(), filled, schedules.data(), offsets.data());
+            for (size_t j = 0; j < filled; j++)
+                for (size_t k = 0; k < BLOCK_BYTE_LEN; k++)
+                    targets[j][k] ^= keystream[j * BLOCK_BYTE_LEN + k];
+            filled = 0;
+        };
+
+        for (size_t i = 0; i < messages.size(); i++) {
+            CTR<ECB<RC6<T>>>::init_counter(counter.data(), tags + i * TAG_BYTE_LEN, BLOCK_BYTE_LEN);
+            for (size_t block = 0; block < lens[i] / BLOCK_BYTE_LEN; block++) {
+                u8* dest = keystream.data() + filled * BLOCK_BYTE_LEN;
+                CTR<ECB<RC6<T>>>::init_block_counter(dest, counter.data(), BLOCK_BYTE_LEN, block);
+                offsets[filled] = i * RC6<T>::SCHEDULE_LEN;
+                targets[filled] = messages[i] + block * BLOCK_BYTE_LEN;
+                if (++filled == KEYSTREAM_BLOCKS)
+                    flush();
+            }
+        }
+        flush();
+    }
+
+    /**
+     * Seal a group of messages of a batch
+     * @param plaintexts: batch messages
+     * @param aads: batch additional authenticated data
+     * @param nonces: batch nonces, NONCE_BYTE_LEN bytes per message
+     * @param begin: first message of the group
+     * @param end: message after the group
+     */
+    void seal_group(vector<vector<u8>>& plaintexts, const vector<vector<u8>>& aads, const u8* nonces,
+                    size_t begin, size_t end)
+    {
+        const size_t count = end - begin;
+        vector<const u8*> message_nonces(count);
+        vector<u8*> messages(count);
+        vector<size_t> lens(count);
+        vector<size_t> padded_lens(count);
+
+        // Lay out nonce || plaintext || padding and tag space
+        for (size_t i = 0; i < count; i++) {
+            vector<u8>& plaintext = plaintexts[begin + i];
+            validate(plaintext.size(), aads[begin + i].size());
+            lens[i] = plaintext.size();
+            padded_lens[i] = lens[i] + padding_len(lens[i]);
+            plaintext.resize(headroom() + lens[i] + tailroom());
+            memmove(plaintext.data() + headroom(), plaintext.data(), lens[i]);
+            copy(nonces + (begin + i) * NONCE_BYTE_LEN, nonces + (begin + i + 1) * NONCE_BYTE_LEN,
+                 plaintext.data());
+            message_nonces[i] = plaintext.data();
+            messages[i] = plaintext.data() + headroom();
+            fill(messages[i] + lens[i], messages[i] + padded_lens[i], 0);
+        }
+
+        vector<vector<u8>> authentication_keys;
+        vector<vector<u8>> encryption_keys;
+        derive_keys(authentication_keys, encryption_keys, message_nonces);
+        const vector<T> schedules = expand_keys(encryption_keys);
+
+        // Calculate tags
+        vector<u8> tags(count * TAG_BYTE_LEN);
+        for (size_t i = 0; i < count; i++) {
+            Polyval<T> authenticator = Polyval<T>(authentication_keys[i]);
+            hash_aad(authenticator, aads[begin + i], false);
+            authenticator.update(messages[i], padded_lens[i]);
+            tag_block(authenticator, aads[begin + i].size(), padded_lens[i], message_nonces[i],
+                      tags.data() + i * TAG_BYTE_LEN);
+        }
+        encrypt_tags(tags.data(), schedules, count);
+
+        // Encrypt
+        crypt_batch(messages, padded_lens, tags.data(), schedules);
+
+        // Tag overwrites the encrypted padding
+        for (size_t i = 0; i < count; i++) {
+            copy(tags.data() + i * TAG_BYTE_LEN, tags.data() + (i + 1) * TAG_BYTE_LEN, messages[i] + lens[i]);
+            plaintexts[begin + i].resize(headroom() + lens[i] + TAG_BYTE_LEN);
+        }
+    }
+
+    /**
+     * Open a group of messages of a batch, wiping those that fail authentication
+     * @param ciphertexts: batch messages
+     * @param aads: batch additional authenticated data
+     * @param begin: first message of the group
+     * @param end: message after the group
+     * @return whether every message of the group authenticated
+     */
+    bool open_group(vector<vector<u8>>& ciphertexts, const vector<vector<u8>>& aads, size_t begin, size_t end)
+    {
+        const size_t count = end - begin;
+        vector<const u8*> nonces(count);
+        vector<u8*> messages(count);
+        vector<size_t> lens(count);
+        vector<size_t> padded_lens(count);
+        vector<u8> tags(count * TAG_BYTE_LEN);
+        bool authenticated = true;
+
+        // Split nonce || ciphertext || tag, the tag space holds the padding
+        for (size_t i = 0; i < count; i++) {
+            vector<u8>& ciphertext = ciphertexts[begin + i];
+            if (ciphertext.size() < NONCE_BYTE_LEN) {
+                string error = "ERROR: Ciphertext to be at least the 96 bytes (nonce size), got "_hidden;
+                cerr << error << ciphertext.size() << "\n";
+                exit(1);
+            }
+
+            nonces[i] = ciphertext.data();
+            messages[i] = ciphertext.data() + headroom();
+            if (ciphertext.size() < headroom() + TAG_BYTE_LEN) {
+                // Too short to hold a tag, fails authentication below against an empty message
+                authenticated = false;
+                ciphertext.resize(headroom() + TAG_BYTE_LEN);
+                nonces[i] = ciphertext.data();
+                messages[i] = ciphertext.data() + headroom();
+            }
+            lens[i] = ciphertext.size() - headroom() - TAG_BYTE_LEN;
+            padded_lens[i] = lens[i] + padding_len(lens[i]);
+            copy(messages[i] + lens[i], messages[i] + lens[i] + TAG_BYTE_LEN, tags.data() + i * TAG_BYTE_LEN);
+        }
+
+        vector<vector<u8>> authentication_keys;
+        vector<vector<u8>> encryption_keys;
+        derive_keys(authentication_keys, encryption_keys, nonces);
+        const vector<T> schedules = expand_keys(encryption_keys);
+
+        // Decrypt
+        crypt_batch(messages, padded_lens, tags.data(), schedules);
+
+        // Calculate tags
+        vector<u8> actual(count * TAG_BYTE_LEN);
+        for (size_t i = 0; i < count; i++) {
+            fill(messages[i] + lens[i], messages[i] + padded_lens[i], 0);
+            Polyval<T> authenticator = Polyval<T>(authentication_keys[i]);
+            hash_aad(authenticator, aads[begin + i], false);
+            authenticator.update(messages[i], padded_lens[i]);
+            tag_block(authenticator, aads[begin + i].size(), padded_lens[i], nonces[i],
+                      actual.data() + i * TAG_BYTE_LEN);
+        }
+        encrypt_tags(actual.data(), schedules, count);
+
+        // Authenticate, then drop nonce and tag
+        for (size_t i = 0; i < count; i++) {
+            vector<u8>& ciphertext = ciphertexts[begin + i];
+            const u8* expected = tags.data() + i * TAG_BYTE_LEN;
+            if (!equal(expected, expected + TAG_BYTE_LEN, actual.data() + i * TAG_BYTE_LEN)) {
+                authenticated = false;
+                fill(ciphertext.begin(), ciphertext.end(), 0);
+            }
+            ciphertext.resize(headroom() + lens[i]);
+            ciphertext.erase(ciphertext.begin(), ciphertext.begin() + headroom());
+        }
+
+        return authenticated;
     }
 
     /**
@@ -1,21 +1,141 @@
 #pragma once
 
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
 
+#include "../../../binops.h"
+#include "../../../cpu.h"
 #include "../../../types.h"
 
+#ifdef ENV_X86
+#include <immintrin.h>
+
+/**
+ * Accumulate the unreduced 256-bit carry-less product a * b as low, middle and high 128-bit terms
+ * @param a: field element, low 64 bits in the low lane
+ * @param b: field element, low 64 bits in the low lane
+ */
+__attribute__((target("pclmul"))) static inline void
+polyval_accumulate_clmul(__m128i a, __m128i b, __m128i& lo, __m128i& mid, __m128i& hi)
+{
+    lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(a, b, 0x00));
+    hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(a, b, 0x11));
+    mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x01));
+    mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x10));
+}
+
+/**
+ * Reduce an accumulated 256-bit product to the Polyval product times x^-128
+ */
+__attribute__((target("pclmul"))) static inline __m128i polyval_reduce_clmul(__m128i lo, __m128i mid,
+                                                                             __m128i hi)
+{
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    // Fold the low half into the high half twice, each step multiplying by x^-64
+    // modulo x^128 + x^127 + x^126 + x^121 + 1
+    const __m128i poly = _mm_setr_epi32(1, 0, 0, 0xc2000000);
+    lo = _mm_xor_si128(_mm_shuffle_epi32(lo, 0x4e), _mm_clmulepi64_si128(lo, poly, 0x10));
+    lo = _mm_xor_si128(_mm_shuffle_epi32(lo, 0x4e), _mm_clmulepi64_si128(lo, poly, 0x10));
+    return _mm_xor_si128(lo, hi);
+}
+
+/**
+ * Polyval product a * b * x^-128 with PCLMULQDQ, a schoolbook multiply and two folding reductions
+ * @param a: field element, low 64 bits in the low lane
+ * @param b: field element, low 64 bits in the low lane
+ */
+__attribute__((target("pclmul"))) static inline __m128i polyval_mul_clmul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    polyval_accumulate_clmul(a, b, lo, mid, hi);
+    return polyval_reduce_clmul(lo, mid, hi);
+}
+
+/**
+ * Hash groups of 8 16-byte blocks into a Polyval state with PCLMULQDQ
+ * Each group is s = (s + X1) * H^8 + X2 * H^7 + ... + X8 * H, eight independent products summed before a
+ * single reduction, equal to eight single-block steps
+ * @param state: 16 byte Polyval state, updated in place
+ * @param powers: H^8, H^7, ..., H^1 as 16 bytes each
+ * @param bytes: 128 * groups bytes of blocks
+ * @param groups: number of 8-block groups
+ */
+__attribute__((target("pclmul"))) static inline void polyval_update_8_clmul(u8* state, const u8* powers,
+                                                                           const u8* bytes, size_t groups)
+{
+    __m128i keys[8];
+    for (size_t j = 0; j < 8; j++)
+        keys[j] = _mm_loadu_si128((const __m128i*) (powers + 16 * j));
+    __m128i s = _mm_loadu_si128((const __m128i*) state);
+
+    for (size_t g = 0; g < groups; g++, bytes += 128) {
+        __m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        for (size_t j = 0; j < 8; j++) {
+            __m128i block = _mm_loadu_si128((const __m128i*) (bytes + 16 * j));
+            if (j == 0)
+                block = _mm_xor_si128(block, s);
+            polyval_accumulate_clmul(block, keys[j], lo, mid, hi);
+        }
+        s = polyval_reduce_clmul(lo, mid, hi);
+    }
+    _mm_storeu_si128((__m128i*) state, s);
+}
+
+/**
+ * Hash groups of 8 16-byte blocks into a Polyval state with VPCLMULQDQ, two products per instruction
+ * Same aggregation as polyval_update_8_clmul, the 256-bit partial sums are folded to 128 bits before reducing
+ * @param state: 16 byte Polyval state, updated in place
+ * @param powers: H^8, H^7, ..., H^1 as 16 bytes each
+ * @param bytes: 128 * groups bytes of blocks
+ * @param groups: number of 8-block groups
+ */
+__attribute__((target("vpclmulqdq,avx2,pclmul"))) static inline void
+polyval_update_8_vpclmul(u8* state, const u8* powers, const u8* bytes, size_t groups)
+{
+    __m256i keys[4];
+    for (size_t j = 0; j < 4; j++)
+        keys[j] = _mm256_loadu_si256((const __m256i*) (powers + 32 * j));
+    __m128i s = _mm_loadu_si128((const __m128i*) state);
+
+    for (size_t g = 0; g < groups; g++, bytes += 128) {
+        __m256i lo = _mm256_setzero_si256(), mid = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        for (size_t j = 0; j < 4; j++) {
+            __m256i blocks = _mm256_loadu_si256((const __m256i*) (bytes + 32 * j));
+            if (j == 0)
+                blocks = _mm256_xor_si256(blocks, _mm256_zextsi128_si256(s));
+            lo = _mm256_xor_si256(lo, _mm256_clmulepi64_epi128(blocks, keys[j], 0x00));
+            hi = _mm256_xor_si256(hi, _mm256_clmulepi64_epi128(blocks, keys[j], 0x11));
+            mid = _mm256_xor_si256(mid, _mm256_xor_si256(_mm256_clmulepi64_epi128(blocks, keys[j], 0x01),
+                                                         _mm256_clmulepi64_epi128(blocks, keys[j], 0x10)));
+        }
+        s = polyval_reduce_clmul(_mm_xor_si128(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1)),
+                                 _mm_xor_si128(_mm256_castsi256_si128(mid), _mm256_extracti128_si256(mid, 1)),
+                                 _mm_xor_si128(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1)));
+    }
+    _mm_storeu_si128((__m128i*) state, s);
+
+    // Avoid AVX-SSE transition penalties in the scalar code that follows
+    _mm256_zeroupper();
+}
+#endif
+
 /// Operater for a 64-bit field
 class FieldElement64
 {
   public:
     FieldElement64(u64 e0, u64 e1) : e0(e0), e1(e1) {}
 
-    FieldElement64(const vector<u8>& bytes) { from_bytes(bytes, 0); }
+    FieldElement64(const vector<u8>& bytes) { from_bytes(bytes.data()); }
 
-    FieldElement64(const vector<u8>& bytes, size_t offset) { from_bytes(bytes, offset); }
+    FieldElement64(const vector<u8>& bytes, size_t offset) { from_bytes(bytes.data() + offset); }
+
+    /// Load from 16 little-endian bytes
+    FieldElement64(const u8* bytes) { from_bytes(bytes); }
 
     FieldElement64(const string& hex)
     {
@@ -27,7 +147,7 @@ class FieldElement64
             bytes.push_back(byte);
         }
 
-        from_bytes(bytes, 0);
+        from_bytes(bytes.data());
     }
 
     string str()
@@ -51,7 +171,26 @@ class FieldElement64
 
     FieldElement64 operator+(const FieldElement64& rhs) { return FieldElement64(e0 ^ rhs.e0, e1 ^ rhs.e1); }
 
+    /// Store as 16 little-endian bytes
+    void store(u8* bytes) const
+    {
+        for (size_t i = 0; i < 8; i++) {
+            bytes[i] = (u8)(e0 >> (8 * i));
+            bytes[8 + i] = (u8)(e1 >> (8 * i));
+        }
+    }
+
     FieldElement64 operator*(const FieldElement64& rhs)
+    {
+#ifdef ENV_X86
+        if (cpu::has_pclmul())
+            return mul_clmul(rhs);
+#endif
+        return mul_software(rhs);
+    }
+
+    /// Portable Karatsuba multiply over bmul64, the path of operator* without carry-less multiply
+    FieldElement64 mul_software(const FieldElement64& rhs)
     {
         const u64 a0 = e0;
         const u64 a1 = e1;
@@ -78,9 +217,23 @@ class FieldElement64
     }
 
   private:
+    /// Builds its tables from the words of H
+    friend class PolyvalTable;
+
     u64 e0;
     u64 e1;
 
+#ifdef ENV_X86
+    /// Hardware carry-less multiply path of operator*
+    __attribute__((target("pclmul"))) FieldElement64 mul_clmul(const FieldElement64& rhs) const
+    {
+        const __m128i product = polyval_mul_clmul(_mm_set_epi64x((long long) e1, (long long) e0),
+                                                  _mm_set_epi64x((long long) rhs.e1, (long long) rhs.e0));
+        return FieldElement64((u64) _mm_cvtsi128_si64(product),
+                              (u64) _mm_cvtsi128_si64(_mm_unpackhi_epi64(product, product)));
+    }
+#endif
+
     u64 rev64(u64 a)
     {
         u64 x = a;
@@ -116,16 +269,15 @@ class FieldElement64
 
     u64 mul_reverse_shift1(u64 a, u64 b) { return rev64(bmul64(a, b)) >> 1; }
 
-    void from_bytes(const vector<u8>& bytes, size_t offset)
+    void from_bytes(const u8* bytes)
     {
-        e0 = ((u64) bytes[offset + 7] << 56) | ((u64) bytes[offset + 6] & 0xff) << 48 |
-             ((u64) bytes[offset + 5] & 0xff) << 40 | ((u64) bytes[offset + 4] & 0xff) << 32 |
-             ((u64) bytes[offset + 3] & 0xff) << 24 | ((u64) bytes[offset + 2] & 0xff) << 16 |
-             ((u64) bytes[offset + 1] & 0xff) << 8 | ((u64) bytes[offset] & 0xff);
-
-        e1 = ((u64) bytes[offset + 15] << 56) | ((u64) bytes[offset + 14] & 0xff) << 48 |
-             ((u64) bytes[offset + 13] & 0xff) << 40 | ((u64) bytes[offset + 12] & 0xff) << 32 |
-             ((u64) bytes[offset + 11] & 0xff) << 24 | ((u64) bytes[offset + 10] & 0xff) << 16 |
-             ((u64) bytes[offset + 9] & 0xff) << 8 | ((u64) bytes[offset + 8] & 0xff);
+        // Unaligned 64-bit loads, elements are little endian
+        memcpy(&e0, bytes, sizeof(e0));
+        memcpy(&e1, bytes + sizeof(e0), sizeof(e1));
+
+        if (is_big_endian()) {
+            e0 = swap_endian(e0);
+            e1 = swap_endian(e1);
+        }
     }
 };
@@ -2,13 +2,17 @@
 
 /// Polyval is a little-endian version of GHASH from GCM
 
+#include <array>
 #include <bits/stdc++.h>
 #include <iomanip>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include "../../../parallel.h"
 #include "fieldelement64.h"
+#include "polyvaltable.h"
 
 /// Abstract authenticator
 class Authenticator
@@ -23,9 +27,80 @@ class Authenticator
 template<class T> class Polyval : public Authenticator
 {
   private:
+    /// Blocks absorbed per aggregated step
+    static const size_t AGGREGATE_BLOCKS = 8;
+    /// Blocks per chunk of a parallel update, 256KB of 16-byte blocks
+    static const size_t PARALLEL_CHUNK_BLOCKS = 16384;
+    /// Fewest chunks handed to a thread by a parallel update
+    static const size_t PARALLEL_MIN_CHUNKS = 2;
+    /// Blocks multiplied by H before building its table pays off
+    static const size_t TABLE_MIN_BLOCKS = 8;
     const size_t BLOCK_SIZE = sizeof(T) * 4;
     FieldElement64 h;
     FieldElement64 s;
+    /// H^8, H^7, ..., H^1 as 16 little-endian bytes each, the multiplier of each block of an aggregated step
+    array<u8, AGGREGATE_BLOCKS * 16> h_powers;
+    /// Powers are computed on first use, short messages never need them
+    bool h_powers_ready = false;
+    /// Byte table for H, built on first use when there is no carry-less multiply, shared by copies
+    shared_ptr<const PolyvalTable> h_table;
+    /// Software multiplies by H done before the table is built
+    size_t software_blocks = 0;
+
+    /// x * H under the Polyval product, through the byte table when there is no carry-less multiply
+    FieldElement64 mul_h(FieldElement64 x)
+    {
+        if (cpu::has_pclmul())
+            return x * h;
+
+        if (!h_table) {
+            // Building the table costs a few software multiplies, short inputs are cheaper without it
+            if (++software_blocks < TABLE_MIN_BLOCKS)
+                return x * h;
+            h_table = make_shared<const PolyvalTable>(h);
+        }
+        return h_table->mul(x);
+    }
+
+    /// Precompute the powers of H used by aggregated steps
+    void init_powers()
+    {
+        h_powers_ready = true;
+        FieldElement64 power = h;
+        for (size_t k = AGGREGATE_BLOCKS; k-- > 0;) {
+            power.store(h_powers.data() + 16 * k);
+            power = power * h;
+        }
+    }
+
+    /**
+     * Absorb groups of AGGREGATE_BLOCKS 16-byte blocks, each as s = (s + X1) * H^8 + X2 * H^7 + ... + X8 * H
+     * The products of a group are independent instead of each waiting on the last
+     * @param bytes: 16 * AGGREGATE_BLOCKS * groups bytes
+     * @param groups: number of groups
+     */
+    void update_aggregated(const u8* bytes, size_t groups)
+    {
+#ifdef ENV_X86
+        if (cpu::has_pclmul()) {
+            if (!h_powers_ready)
+                init_powers();
+
+            u8 state[16];
+            s.store(state);
+            if (cpu::has_vpclmulqdq())
+                polyval_update_8_vpclmul(state, h_powers.data(), bytes, groups);
+            else
+                polyval_update_8_clmul(state, h_powers.data(), bytes, groups);
+            s = FieldElement64(state);
+            return;
+        }
+#endif
+
+        // Without carry-less multiply a table lookup per block beats aggregating software multiplies
+        for (size_t i = 0; i < groups * AGGREGATE_BLOCKS; i++)
+            update_block(FieldElement64(bytes + 16 * i));
+    }
 
   public:
     Polyval(u64 h0, u64 h1) : h(FieldElement64(h0, h1)), s(FieldElement64(0L, 0L)) {}
@@ -42,19 +117,81 @@ template<class T> class Polyval : public Authenticator
 
     vector<u8> digest() { return s.bytes(); }
 
-    void update(const vector<u8>& bytes)
-    {
-        const size_t remainder = 0 ? bytes.size() < BLOCK_SIZE : bytes.size() % BLOCK_SIZE;
+    void update(const vector<u8>& bytes) { update(bytes.data(), bytes.size()); }
 
-        for (size_t i = 0; i < bytes.size() - remainder; i += BLOCK_SIZE) {
-            FieldElement64 block_update = FieldElement64(bytes, i);
-            update_block(block_update);
+    /**
+     * Absorb bytes in place, zero-padding a trailing partial block
+     * @param bytes: data to absorb
+     * @param len: byte length
+     */
+    void update(const u8* bytes, size_t len)
+    {
+        const size_t remainder = len % BLOCK_SIZE;
+        size_t i = 0;
+
+        // Whole groups of 16-byte blocks take the aggregated path
+        const size_t groups = BLOCK_SIZE == 16 ? len / (16 * AGGREGATE_BLOCKS) : 0;
+        if (groups) {
+            update_aggregated(bytes, groups);
+            i = groups * 16 * AGGREGATE_BLOCKS;
         }
 
+        for (; i < len - remainder; i += BLOCK_SIZE)
+            update_block(FieldElement64(bytes + i));
+
+        // Pad the trailing partial block on the stack, short AADs and messages hit this on every call
         if (remainder) {
-            vector<u8> block(bytes.begin(), bytes.end() - remainder);
-            const FieldElement64 block_update = FieldElement64(block);
-            update_block(block_update);
+            u8 block[sizeof(T) * 4] = {};
+            copy(bytes + len - remainder, bytes + len, block);
+            update_block(FieldElement64(block));
+        }
+    }
+
+    /**
+     * Absorb bytes across the pool, giving the same digest as update
+     * Whole chunks are hashed from a zero state each and chained with powers of H afterwards
+     * @param bytes: data to absorb
+     * @param len: byte length
+     */
+    void update_parallel(const u8* bytes, size_t len)
+    {
+        const size_t chunk_size = PARALLEL_CHUNK_BLOCKS * BLOCK_SIZE;
+        const size_t chunks = len / chunk_size;
+        if (chunks < 2 * PARALLEL_MIN_CHUNKS) {
+            update(bytes, len);
+            return;
+        }
+
+        // Set up the multiplier once so every partial shares it instead of building it per chunk
+        prepare_multiplier();
+        vector<Polyval> partials(chunks, *this);
+
+        auto hash_chunks = [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++) {
+                partials[c].reset();
+                partials[c].update(bytes + c * chunk_size, chunk_size);
+            }
+        };
+        parallel::for_each_range(chunks, PARALLEL_MIN_CHUNKS, hash_chunks);
+
+        const FieldElement64 h_chunk = h_power(PARALLEL_CHUNK_BLOCKS);
+        for (const Polyval& partial : partials)
+            combine(partial, h_chunk);
+
+        update(bytes + chunks * chunk_size, len - chunks * chunk_size);
+    }
+
+    /**
+     * Set up the multiplier by H now instead of on first use, so copies made to hash partial inputs share
+     * it rather than each building their own
+     */
+    void prepare_multiplier()
+    {
+        if (cpu::has_pclmul()) {
+            if (!h_powers_ready)
+                init_powers();
+        } else if (!h_table) {
+            h_table = make_shared<const PolyvalTable>(h);
         }
     }
 
@@ -75,7 +212,7 @@ template<class T> class Polyval : public Authenticator
         }
     }
 
-    void update_block(const FieldElement64& update) { s = (s + update) * h; }
+    void update_block(const FieldElement64& update) { s = mul_h(s + update); }
 
     void update_block(const string& update_hex)
     {
@@ -83,6 +220,33 @@ template<class T> class Polyval : public Authenticator
         update_block(update_element);
     }
 
+    /**
+     * H raised to the n-th power under the Polyval product, the factor a state picks up over n blocks
+     * @param n: number of blocks, at least 1
+     */
+    FieldElement64 h_power(size_t n)
+    {
+        FieldElement64 result = h;
+        size_t bit = 1;
+        while (bit <= n / 2)
+            bit <<= 1;
+
+        // Square and multiply from the bit below the highest set one
+        for (bit >>= 1; bit; bit >>= 1) {
+            result = result * result;
+            if (n & bit)
+                result = result * h;
+        }
+        return result;
+    }
+
+    /**
+     * Continue this state with blocks hashed separately, as if they had been hashed here
+     * @param next: authenticator with the same key that hashed the following blocks from a zero state
+     * @param h_n: h_power(n) for the n blocks next hashed
+     */
+    void combine(const Polyval& next, FieldElement64 h_n) { s = s * h_n + next.s; }
+
     void reset() { s = FieldElement64(0L, 0L); }
 
     string str() { return s.str(); }
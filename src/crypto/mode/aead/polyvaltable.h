@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+
+#include "../../../types.h"
+#include "fieldelement64.h"
+
+/**
+ * Reduction of a byte n shifted out of a Shoup step, n(x) * x^-8 modulo x^128 + x^127 + x^126 + x^121 + 1
+ * x^-1 is x^127 + x^126 + x^125 + x^120 and has no low bits, so x^-8 .. x^-1 are shifts of it
+ */
+static constexpr array<u64, 256> polyval_reduction_table()
+{
+    array<u64, 256> reduction{};
+    for (size_t n = 0; n < 256; n++)
+        for (size_t j = 0; j < 8; j++)
+            if (n & (1 << j))
+                reduction[n] ^= 0xe100000000000000 >> (7 - j);
+    return reduction;
+}
+
+/**
+ * Shoup 8-bit table multiplication by a fixed H, for CPUs without carry-less multiply
+ *
+ * The Polyval product X * H * x^-128 is evaluated a byte at a time from the low end of X:
+ *   acc = (acc + b_k(x) * H) * x^-8,  k = 0 .. 15
+ * with b(x) * H taken from a 256-entry table built once per H, and the reduction of each x^-8 step
+ * taken from a fixed 256-entry table of the bits shifted out.
+ */
+class PolyvalTable
+{
+  public:
+    /**
+     * Constructor for PolyvalTable
+     * @param h: fixed multiplier
+     */
+    explicit PolyvalTable(const FieldElement64& h)
+    {
+        // Entries for single bits are H * x^j, the rest are sums of those
+        table_lo[0] = table_hi[0] = 0;
+        u64 lo = h.e0;
+        u64 hi = h.e1;
+        for (size_t bit = 1; bit < 256; bit <<= 1) {
+            for (size_t n = 0; n < bit; n++) {
+                table_lo[bit | n] = lo ^ table_lo[n];
+                table_hi[bit | n] = hi ^ table_hi[n];
+            }
+
+            // Multiply by x modulo x^128 + x^127 + x^126 + x^121 + 1
+            const u64 carry = hi >> 63;
+            hi = ((hi << 1) | (lo >> 63)) ^ (carry ? 0xc200000000000000 : 0);
+            lo = (lo << 1) ^ carry;
+        }
+    }
+
+    /**
+     * Polyval product with the fixed H
+     * @param x: field element
+     * @return x * H * x^-128
+     */
+    FieldElement64 mul(const FieldElement64& x) const
+    {
+        u64 lo = 0;
+        u64 hi = 0;
+        for (u64 word : {x.e0, x.e1}) {
+            for (size_t k = 0; k < 8; k++, word >>= 8) {
+                const size_t n = word & 0xff;
+                lo ^= table_lo[n];
+                hi ^= table_hi[n];
+
+                // Multiply by x^-8, folding the byte shifted out back in from the top
+                const size_t shifted_out = lo & 0xff;
+                lo = (lo >> 8) | (hi << 56);
+                hi = (hi >> 8) ^ REDUCTION[shifted_out];
+            }
+        }
+        return FieldElement64(lo, hi);
+    }
+
+  private:
+    static constexpr array<u64, 256> REDUCTION = polyval_reduction_table();
+
+    /// b(x) * H for every byte b, low and high words
+    array<u64, 256> table_lo;
+    array<u64, 256> table_hi;
+};
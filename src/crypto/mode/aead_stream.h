@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../../parallel.h"
+#include "aead.h"
+
+/**
+ * Segmented (STREAM) authenticated encryption built on AEAD
+ *
+ * The message is split into fixed-size segments, each sealed with its own nonce:
+ *   nonce = prefix (7 bytes) || segment index (32-bit big endian) || last segment flag (1 byte)
+ * so segments can be processed independently in bounded memory, while reordering, dropping or
+ * truncating segments fails authentication.
+ *
+ * Layout: prefix || segment size (32-bit little endian) || segment 0 || ... || last segment,
+ * every segment is its ciphertext followed by a tag, only the last segment may be short.
+ */
+template<class T> class StreamAEAD
+{
+  public:
+    /// Plaintext bytes per segment unless configured otherwise
+    static const size_t DEFAULT_SEGMENT_SIZE = 64 * 1024;
+
+    /**
+     * Constructor for StreamAEAD
+     * @param key_generating_key: key generating key to derive per-segment keys from
+     * @param segment_size: plaintext bytes per segment
+     */
+    StreamAEAD(const vector<u8>& key_generating_key, size_t segment_size = DEFAULT_SEGMENT_SIZE)
+        : key_generating_key(key_generating_key), aead(this->key_generating_key), SEGMENT_SIZE(segment_size)
+    {
+        if (SEGMENT_SIZE == 0 || SEGMENT_SIZE > UINT32_MAX) {
+            string error = "Segment size must be between 1 and 2^32 - 1 bytes, got "_hidden;
+            throw runtime_error(error + to_string(SEGMENT_SIZE));
+        }
+    }
+
+    /// aead refers to this object's key, a copy or move would leave it pointing into the source
+    StreamAEAD(const StreamAEAD&) = delete;
+    StreamAEAD& operator=(const StreamAEAD&) = delete;
+
+    /**
+     * Encrypt message, sealing segments in parallel
+     * @param plaintext: plaintext to encrypt, replaced by the segmented ciphertext
+     * @param aad: additional authenticated data, bound to every segment
+     */
+    void seal(vector<u8>& plaintext, const vector<u8>& aad)
+    {
+        const vector<u8> prefix = random_prefix();
+        const size_t plaintext_size = plaintext.size();
+        const size_t segments = max((size_t) 1, (plaintext_size + SEGMENT_SIZE - 1) / SEGMENT_SIZE);
+
+        // Spread segments out to their sealed offsets, back to front so none is overwritten before it moves
+        plaintext.resize(header_size() + plaintext_size + segments * TAG_BYTE_LEN);
+        for (size_t i = segments; i-- > 0;) {
+            const size_t offset = i * SEGMENT_SIZE;
+            const size_t len = min(SEGMENT_SIZE, plaintext_size - offset);
+            u8* segment = plaintext.data() + header_size() + i * sealed_segment_size();
+            memmove(segment, plaintext.data() + offset, len);
+        }
+        write_header(plaintext.data(), prefix);
+
+        auto seal_range = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const size_t len = min(SEGMENT_SIZE, plaintext_size - i * SEGMENT_SIZE);
+                u8* segment = plaintext.data() + header_size() + i * sealed_segment_size();
+                seal_segment(segment, len, aad, prefix, i, i == segments - 1);
+            }
+        };
+        parallel::for_each_range(segments, 1, seal_range);
+    }
+
+    /**
+     * Decrypt and authenticate message, opening segments in parallel
+     * On failure the whole buffer is wiped before the authentication error is rethrown
+     * @param ciphertext: segmented ciphertext, replaced by the plaintext
+     * @param aad: additional authenticated data
+     */
+    void open(vector<u8>& ciphertext, const vector<u8>& aad)
+    {
+        const vector<u8> prefix = read_header(ciphertext.data(), ciphertext.size());
+        const size_t body_size = ciphertext.size() - header_size();
+        const size_t segments =
+            max((size_t) 1, (body_size + sealed_segment_size() - 1) / sealed_segment_size());
+        const size_t last_size = body_size - (segments - 1) * sealed_segment_size();
+
+        if (last_size < TAG_BYTE_LEN) {
+            string msg = "AEAD authentication failed"_hidden;
+            throw runtime_error(msg);
+        }
+
+        auto open_range = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const size_t len = i == segments - 1 ? last_size : sealed_segment_size();
+                u8* segment = ciphertext.data() + header_size() + i * sealed_segment_size();
+                open_segment(segment, len, aad, prefix, i, i == segments - 1);
+            }
+        };
+        try {
+            parallel::for_each_range(segments, 1, open_range);
+        } catch (...) {
+            // Segments that did authenticate must not outlive the one that did not
+            fill(ciphertext.begin(), ciphertext.end(), 0);
+            throw;
+        }
+
+        // Close the gaps left by header and tags, front to back so none is overwritten before it moves
+        for (size_t i = 0; i < segments; i++) {
+            const size_t len = (i == segments - 1 ? last_size : sealed_segment_size()) - TAG_BYTE_LEN;
+            const u8* segment = ciphertext.data() + header_size() + i * sealed_segment_size();
+            memmove(ciphertext.data() + i * SEGMENT_SIZE, segment, len);
+        }
+        ciphertext.resize(body_size - segments * TAG_BYTE_LEN);
+    }
+
+    /**
+     * Encrypt a stream in bounded memory, holding one segment per pool thread at a time
+     * @param input: plaintext source, read to the end
+     * @param output: segmented ciphertext sink
+     * @param aad: additional authenticated data, bound to every segment
+     */
+    void seal(istream& input, ostream& output, const vector<u8>& aad)
+    {
+        const vector<u8> prefix = random_prefix();
+        vector<u8> header(header_size());
+        write_header(header.data(), prefix);
+        output.write((const char*) header.data(), header.size());
+
+        process_stream(input, output, SEGMENT_SIZE, [&](vector<u8>& segment, u64 index, bool last) {
+            const size_t len = segment.size();
+            segment.resize(len + TAG_BYTE_LEN);
+            seal_segment(segment.data(), len, aad, prefix, index, last);
+        });
+    }
+
+    /**
+     * Decrypt and authenticate a stream in bounded memory, holding one segment per pool thread at a time
+     * Plaintext of authenticated segments is written as it is verified, a failure throws part way through
+     * after wiping the batch it was found in
+     * @param input: segmented ciphertext source, read to the end
+     * @param output: plaintext sink
+     * @param aad: additional authenticated data
+     */
+    void open(istream& input, ostream& output, const vector<u8>& aad)
+    {
+        vector<u8> header(header_size());
+        input.read((char*) header.data(), header.size());
+        const vector<u8> prefix = read_header(header.data(), input.gcount());
+
+        process_stream(input, output, sealed_segment_size(), [&](vector<u8>& segment, u64 index, bool last) {
+            segment.resize(open_segment(segment.data(), segment.size(), aad, prefix, index, last));
+        });
+    }
+
+#ifndef DEBUG
+  private:
+#endif
+    static const size_t NONCE_PREFIX_LEN = 7;
+    static const size_t TAG_BYTE_LEN = block_byte_size<T>();
+    /// Segment indices are 32 bits in the nonce
+    static const u64 MAX_SEGMENTS = (u64) 1 << 32;
+
+    const vector<u8> key_generating_key;
+    AEAD<T> aead;
+    const size_t SEGMENT_SIZE;
+
+    size_t header_size() const { return NONCE_PREFIX_LEN + sizeof(u32); }
+
+    size_t sealed_segment_size() const { return SEGMENT_SIZE + TAG_BYTE_LEN; }
+
+    static vector<u8> random_prefix()
+    {
+        vector<u8> prefix(NONCE_PREFIX_LEN);
+        AEAD<T>::random_nonce_bytes(prefix.data(), prefix.size());
+        return prefix;
+    }
+
+    void write_header(u8* header, const vector<u8>& prefix) const
+    {
+        copy(prefix.begin(), prefix.end(), header);
+        for (size_t k = 0; k < sizeof(u32); k++)
+            header[NONCE_PREFIX_LEN + k] = (u8)(SEGMENT_SIZE >> (8 * k));
+    }
+
+    /**
+     * Validate header and retrieve nonce prefix
+     * @param header: start of the segmented ciphertext
+     * @param len: available bytes
+     */
+    vector<u8> read_header(const u8* header, size_t len) const
+    {
+        if (len < header_size()) {
+            string msg = "AEAD authentication failed"_hidden;
+            throw runtime_error(msg);
+        }
+
+        u32 segment_size = 0;
+        for (size_t k = 0; k < sizeof(u32); k++)
+            segment_size |= (u32) header[NONCE_PREFIX_LEN + k] << (8 * k);
+        if (segment_size != SEGMENT_SIZE) {
+            string error = "Stream was sealed with a different segment size, got "_hidden;
+            throw runtime_error(error + to_string(segment_size));
+        }
+
+        return vector<u8>(header, header + NONCE_PREFIX_LEN);
+    }
+
+    /**
+     * Build the nonce for a segment
+     * @param prefix: per-message random nonce prefix
+     * @param index: segment index
+     * @param last: whether this is the final segment
+     */
+    static vector<u8> segment_nonce(const vector<u8>& prefix, u64 index, bool last)
+    {
+        if (index >= MAX_SEGMENTS) {
+            string error = "Stream exceeds 2^32 segments"_hidden;
+            throw runtime_error(error);
+        }
+
+        vector<u8> nonce(prefix);
+        for (int shift = 24; shift >= 0; shift -= 8)
+            nonce.push_back((u8)(index >> shift));
+        nonce.push_back(last ? 1 : 0);
+        return nonce;
+    }
+
+    /**
+     * Seal one segment in place
+     * @param segment: plaintext followed by TAG_BYTE_LEN bytes for the tag
+     * @param len: plaintext byte length
+     * @param aad: additional authenticated data
+     * @param prefix: per-message nonce prefix
+     * @param index: segment index
+     * @param last: whether this is the final segment
+     */
+    void seal_segment(u8* segment, size_t len, const vector<u8>& aad, const vector<u8>& prefix, u64 index,
+                      bool last)
+    {
+        aead.seal(segment, len, aad, segment_nonce(prefix, index, last).data(), false);
+    }
+
+    /**
+     * Open one segment in place
+     * @param segment: ciphertext || tag
+     * @param len: byte length of ciphertext || tag
+     * @param aad: additional authenticated data
+     * @param prefix: per-message nonce prefix
+     * @param index: segment index
+     * @param last: whether this is the final segment
+     * @return plaintext length
+     */
+    size_t open_segment(u8* segment, size_t len, const vector<u8>& aad, const vector<u8>& prefix, u64 index,
+                        bool last)
+    {
+        return aead.open(segment, len, aad, segment_nonce(prefix, index, last).data(), false);
+    }
+
+    /**
+     * Read input in segments, process a batch of them in parallel, and write them out in order
+     * @param input: source stream
+     * @param output: sink stream
+     * @param read_size: bytes per input segment
+     * @param process: transforms one segment in place given its index and whether it is last
+     */
+    void process_stream(istream& input, ostream& output, size_t read_size,
+                        const function<void(vector<u8>&, u64, bool)>& process)
+    {
+        const size_t batch_size = ThreadPool::shared().concurrency();
+        vector<vector<u8>> batch(batch_size);
+        u64 index = 0;
+        bool last = false;
+
+        while (!last) {
+            size_t filled = 0;
+            for (; filled < batch_size && !last; filled++) {
+                vector<u8>& segment = batch[filled];
+                segment.resize(read_size);
+                input.read((char*) segment.data(), read_size);
+                segment.resize(input.gcount());
+                // A segment is last when nothing follows it
+                last = input.peek() == char_traits<char>::eof();
+            }
+
+            const u64 first = index;
+            auto process_range = [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                    process(batch[i], first + i, last && i == filled - 1);
+            };
+            try {
+                parallel::for_each_range(filled, 1, process_range);
+            } catch (...) {
+                // Nothing of a failed batch is written, and nothing of it is left behind in memory either
+                for (vector<u8>& segment : batch)
+                    fill(segment.begin(), segment.end(), 0);
+                throw;
+            }
+
+            for (size_t i = 0; i < filled; i++)
+                output.write((const char*) batch[i].data(), batch[i].size());
+            index += filled;
+        }
+    }
+};
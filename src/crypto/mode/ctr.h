@@ -1,10 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
-#include <queue>
-#include <thread>
 #include <vector>
 
+#include "../../parallel.h"
 #include "../../types.h"
 
 /// CTR mode of operation
@@ -26,12 +26,30 @@ template<class V> class CTR
      */
     void crypt(vector<u8>& input, const vector<u8>& encryption_key, const vector<u8>& tag)
     {
-        vector<u8> counter;
-        init_counter(counter, tag);
+        cipher.set_key(encryption_key);
+        crypt(input, tag);
+    }
+
+    /**
+     * Crypt used for both encrypt and decrypt in counter mode, cipher must already be keyed
+     * @param input: message to encrypt
+     * @param tag: calculated tag to use as counter
+     */
+    void crypt(vector<u8>& input, const vector<u8>& tag) { crypt(input.data(), input.size(), tag.data()); }
+
+    /**
+     * Crypt used for both encrypt and decrypt in counter mode in place, cipher must already be keyed
+     * @param input: message to encrypt
+     * @param len: message byte length
+     * @param tag: calculated tag of BLOCK_SIZE bytes to use as counter
+     */
+    void crypt(u8* input, size_t len, const u8* tag)
+    {
+        u8 counter[MAX_BLOCK_SIZE];
+        init_counter(counter, tag, BLOCK_SIZE);
 
         // Encrypt blocks in CTR mode using the tag as the counter
-        for (size_t i = 0; i < input.size(); i += BLOCK_SIZE)
-            crypt_block(input, encryption_key, counter, i);
+        crypt_range(input, counter, BLOCK_SIZE, cipher, 0, len);
     }
 
     /**
@@ -42,77 +60,118 @@ template<class V> class CTR
      */
     void crypt_parallel(vector<u8>& input, const vector<u8>& encryption_key, const vector<u8>& tag)
     {
-        const auto processor_count = std::thread::hardware_concurrency();
-        queue<thread> threads;
-
-        vector<u8> last_counter(16);
-        init_counter(last_counter, tag);
-
-        // for block in input
-        // adjust counter forward to block number, spawn block on thread
-        // constrained to max CPUs
-        for (size_t i = 0; i < input.size(); i += BLOCK_SIZE) {
-            if (threads.size() >= processor_count) {
-                threads.front().join();
-                threads.pop();
-            }
-
-            threads.push(thread([this, &input, encryption_key, last_counter, i] {
-                vector<u8> counter = vector<u8>(last_counter.begin(), last_counter.end());
-                crypt_block_parallel(input, encryption_key, counter, this->BLOCK_SIZE, this->cipher, i);
-            }));
-
-            for (size_t k = 0; k < 4; k++)
-                if (++last_counter[k])
-                    break;
-        }
+        cipher.set_key(encryption_key);
+        crypt_parallel(input, tag);
+    }
+
+    /**
+     * Crypt used for both encrypt and decrypt in counter mode, parallelized, cipher must already be keyed
+     * @param input: message to encrypt
+     * @param tag: calculated tag to use as counter
+     */
+    void crypt_parallel(vector<u8>& input, const vector<u8>& tag)
+    {
+        crypt_parallel(input.data(), input.size(), tag.data());
+    }
+
+    /**
+     * Crypt used for both encrypt and decrypt in counter mode in place, parallelized, cipher must already be
+     * keyed
+     * Splits the input into one contiguous chunk per pool thread, inputs under PARALLEL_MIN_BLOCKS run inline
+     * @param input: message to encrypt
+     * @param len: message byte length
+     * @param tag: calculated tag of BLOCK_SIZE bytes to use as counter
+     * @param max_workers: cap on threads used, 0 for the whole shared pool
+     */
+    void crypt_parallel(u8* input, size_t len, const u8* tag, size_t max_workers = 0)
+    {
+        u8 counter[MAX_BLOCK_SIZE];
+        init_counter(counter, tag, BLOCK_SIZE);
+
+        // Each chunk derives its counters from its block offset, so chunks need no shared state
+        const size_t blocks = (len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        auto crypt_chunk = [this, input, len, &counter](size_t begin, size_t end) {
+            crypt_range(input, counter, BLOCK_SIZE, cipher, begin * BLOCK_SIZE, min(end * BLOCK_SIZE, len));
+        };
+        parallel::for_each_range(blocks, PARALLEL_MIN_BLOCKS, crypt_chunk, max_workers);
+    }
 
-        while (threads.size()) {
-            threads.front().join();
-            threads.pop();
+    /**
+     * Crypt a byte range of the input, generating keystream for BATCH_BLOCKS counters per cipher call
+     * cipher must already be keyed
+     * @param input: full message buffer
+     * @param counter: initial counter from init_counter
+     * @param block_size: block cipher size
+     * @param cipher: keyed cipher providing encrypt_blocks
+     * @param begin: block-aligned byte offset to start at
+     * @param end: byte offset to stop at
+     */
+    static void crypt_range(u8* input, const u8* counter, size_t block_size, V& cipher, size_t begin,
+                            size_t end)
+    {
+        alignas(32) u8 keystream[BATCH_BLOCKS * MAX_BLOCK_SIZE];
+        const size_t keystream_size = BATCH_BLOCKS * block_size;
+
+        for (size_t offset = begin; offset < end; offset += keystream_size) {
+            const size_t len = min(keystream_size, end - offset);
+            const size_t blocks = (len + block_size - 1) / block_size;
+
+            // Counter for block n is the initial counter with its first 32-bit word advanced by n
+            for (size_t j = 0; j < blocks; j++)
+                init_block_counter(&keystream[j * block_size], counter, block_size, offset / block_size + j);
+            cipher.encrypt_blocks(keystream, blocks);
+
+            for (size_t j = 0; j < len; j++)
+                input[offset + j] ^= keystream[j];
         }
     }
 
     /**
-     * Crypt used for both encrypt/decrypt with externally tracked counter for use in streams
-     * init_counter MUST be called on counter with tag before operating this
-     * @param input_block: block to encrypt
-     * @param encryption_key: message encryption key
-     * @param counter: vector of u8 to store updating counter in
-     * @param offset: only used internally for crypt() to move along the full input buffer
+     * Write the counter for a block index, wrapping the first 32-bit little endian word like crypt_block
+     * @param dest: block_size bytes to store counter block in
+     * @param counter: initial counter from init_counter
+     * @param block_size: block cipher size
+     * @param block_index: number of blocks after the initial counter
      */
-    static void crypt_block_parallel(vector<u8>& input, const vector<u8>& encryption_key,
-                                     const vector<u8>& counter, size_t block_size, V& cipher,
-                                     size_t offset = 0)
+    static void init_block_counter(u8* dest, const u8* counter, size_t block_size, u64 block_index)
     {
-        vector<u8> block_key(block_size);
-        block_key.insert(block_key.begin(), counter.begin(), counter.end());
-        cipher.encrypt(block_key, encryption_key);
+        copy(counter, counter + block_size, dest);
 
-        for (size_t j = 0; j < min(block_size, input.size()); j++)
-            input[offset + j] ^= block_key[j];
+        u32 low = (u32) counter[0] | ((u32) counter[1] << 8) | ((u32) counter[2] << 16) |
+                  ((u32) counter[3] << 24);
+        low += (u32) block_index;
+        for (size_t k = 0; k < 4; k++)
+            dest[k] = (u8)(low >> (8 * k));
     }
 
     /**
      * Crypt used for both encrypt/decrypt with externally tracked counter for use in streams
-     * init_counter MUST be called on counter with tag before operating this
+     * init_counter MUST be called on counter with tag before operating this, cipher must already be keyed
      * @param input_block: block to encrypt
-     * @param encryption_key: message encryption key
      * @param counter: vector of u8 to store updating counter in
      * @param offset: only used internally for crypt() to move along the full input buffer
      */
-    void crypt_block(vector<u8>& input, const vector<u8>& encryption_key, vector<u8>& counter,
-                     size_t offset = 0)
+    void crypt_block(vector<u8>& input, vector<u8>& counter, size_t offset = 0)
     {
-        vector<u8> block_key(BLOCK_SIZE);
-        block_key.insert(block_key.begin(), counter.begin(), counter.end());
-        cipher.encrypt(block_key, encryption_key);
+        crypt_block(input.data() + offset, min(BLOCK_SIZE, input.size() - offset), counter.data());
+    }
 
-        for (size_t j = 0; j < min(BLOCK_SIZE, input.size()); j++)
-            input[offset + j] ^= block_key[j];
+    /**
+     * Crypt used for both encrypt/decrypt with externally tracked counter for use in streams
+     * init_counter MUST be called on counter with tag before operating this, cipher must already be keyed
+     * @param input_block: block to encrypt in place
+     * @param len: bytes to crypt, at most BLOCK_SIZE
+     * @param counter: BLOCK_SIZE bytes to store updating counter in
+     */
+    void crypt_block(u8* input_block, size_t len, u8* counter)
+    {
+        u8 block_key[MAX_BLOCK_SIZE];
+        copy(counter, counter + BLOCK_SIZE, block_key);
+        cipher.encrypt(block_key, BLOCK_SIZE);
+
+        for (size_t j = 0; j < min(BLOCK_SIZE, len); j++)
+            input_block[j] ^= block_key[j];
 
-        // TODO: This calculation should be done externally, so parallel blocks
-        // can encrypt
         // Increment counter bytes
         for (size_t k = 0; k < 4; k++)
             if (++counter[k])
@@ -125,14 +184,32 @@ template<class V> class CTR
      * @param tag: calculated tag for initial state of counter
      */
     static void init_counter(vector<u8>& counter, const vector<u8>& tag)
+    {
+        counter.resize(tag.size());
+        init_counter(counter.data(), tag.data(), tag.size());
+    }
+
+    /**
+     * Initialize counter to initial state before iterating over blocks
+     * @param counter: block_size bytes to store tagged counter
+     * @param tag: calculated tag for initial state of counter
+     * @param block_size: block cipher size
+     */
+    static void init_counter(u8* counter, const u8* tag, size_t block_size)
     {
         // Copy tag into counter
-        counter = tag;
+        copy(tag, tag + block_size, counter);
         // OR last byte of counter with 0x80
-        counter[counter.size() - 1] |= 0x80;
+        counter[block_size - 1] |= 0x80;
     }
 
   private:
+    /// Counter blocks encrypted per cipher call, a multiple of the widest multi-block kernel
+    static const size_t BATCH_BLOCKS = 64;
+    /// Fewest blocks handed to a thread by crypt_parallel, 64KB of RC6-128
+    static const size_t PARALLEL_MIN_BLOCKS = 4096;
+    /// Largest supported block, 256-bit
+    static const size_t MAX_BLOCK_SIZE = 32;
     V& cipher;
     size_t BLOCK_SIZE;
 };
@@ -1,8 +1,8 @@
 #pragma once
 
-#include <iterator>
 #include <vector>
 
+#include "../../parallel.h"
 #include "../../types.h"
 #include "../../util.h"
 
@@ -12,31 +12,105 @@ template<class T> class ECB : CipherInterface<T>
   public:
     ECB(T& cipher) : BLOCK_SIZE(4 * cipher.block_size()), cipher(cipher) {}
 
+    /**
+     * Expand key once in the underlying cipher for keyed encrypt/decrypt
+     * @param key: key bytes
+     */
+    void set_key(const vector<u8>& key) { cipher.set_key(key); }
+
+    /**
+     * Encrypt consecutive blocks in place with the key passed to set_key, using the cipher's multi-block path
+     * @param blocks: block-aligned data
+     * @param count: number of blocks
+     */
+    void encrypt_blocks(u8* blocks, size_t count) { cipher.encrypt_blocks(blocks, count); }
+
+    /**
+     * Decrypt consecutive blocks in place with the key passed to set_key, using the cipher's multi-block path
+     * @param blocks: block-aligned data
+     * @param count: number of blocks
+     */
+    void decrypt_blocks(u8* blocks, size_t count) { cipher.decrypt_blocks(blocks, count); }
+
+    /**
+     * Encrypt block-aligned data in place with the key passed to set_key
+     * @param data: data to encrypt
+     * @param len: byte length, a multiple of the block size
+     */
+    void encrypt(u8* data, size_t len) { encrypt_blocks(data, len / BLOCK_SIZE); }
+
+    /**
+     * Decrypt block-aligned data in place with the key passed to set_key
+     * @param data: data to decrypt
+     * @param len: byte length, a multiple of the block size
+     */
+    void decrypt(u8* data, size_t len) { decrypt_blocks(data, len / BLOCK_SIZE); }
+
+    /**
+     * Encrypt block-aligned data in place with the key passed to set_key, split across cores when large
+     * @param data: data to encrypt
+     * @param len: byte length, a multiple of the block size
+     */
+    void encrypt_parallel(u8* data, size_t len)
+    {
+        auto encrypt_range = [this, data](size_t begin, size_t end) {
+            encrypt_blocks(data + begin * BLOCK_SIZE, end - begin);
+        };
+        parallel::for_each_range(len / BLOCK_SIZE, PARALLEL_MIN_BLOCKS, encrypt_range);
+    }
+
+    /**
+     * Decrypt block-aligned data in place with the key passed to set_key, split across cores when large
+     * @param data: data to decrypt
+     * @param len: byte length, a multiple of the block size
+     */
+    void decrypt_parallel(u8* data, size_t len)
+    {
+        auto decrypt_range = [this, data](size_t begin, size_t end) {
+            decrypt_blocks(data + begin * BLOCK_SIZE, end - begin);
+        };
+        parallel::for_each_range(len / BLOCK_SIZE, PARALLEL_MIN_BLOCKS, decrypt_range);
+    }
+
+    /**
+     * Encrypt data with the key passed to set_key, split across cores when large
+     * @param data: block-aligned data to encrypt in place
+     */
+    void encrypt_parallel(vector<u8>& data) { encrypt_parallel(data.data(), data.size()); }
+
+    /**
+     * Decrypt data with the key passed to set_key, split across cores when large
+     * @param data: block-aligned data to decrypt in place
+     */
+    void decrypt_parallel(vector<u8>& data) { decrypt_parallel(data.data(), data.size()); }
+
+    /**
+     * Encrypt data with the key passed to set_key
+     * @param data: block-aligned data to encrypt in place
+     */
+    void encrypt(vector<u8>& data) { encrypt(data.data(), data.size()); }
+
+    /**
+     * Decrypt data with the key passed to set_key
+     * @param data: block-aligned data to decrypt in place
+     */
+    void decrypt(vector<u8>& data) { decrypt(data.data(), data.size()); }
+
     void encrypt(vector<u8>& data, const vector<u8>& key)
     {
-        size_t offset = 0;
-        for (auto block = data.begin(); block != data.end(); block += BLOCK_SIZE, offset += BLOCK_SIZE) {
-            vector<u8> chunk = vector<u8>(block, block + BLOCK_SIZE);
-            cipher.encrypt(chunk, key);
-
-            for (size_t i = 0; i < BLOCK_SIZE; i++)
-                data[offset + i] = chunk[i];
-        }
+        set_key(key);
+        encrypt(data);
     }
 
     void decrypt(vector<u8>& data, const vector<u8>& key)
     {
-        size_t offset = 0;
-        for (auto block = data.begin(); block != data.end(); block += BLOCK_SIZE, offset += BLOCK_SIZE) {
-            vector<u8> chunk = vector<u8>(block, block + BLOCK_SIZE);
-            cipher.decrypt(chunk, key);
-
-            for (size_t i = 0; i < BLOCK_SIZE; i++)
-                data[offset + i] = chunk[i];
-        }
+        set_key(key);
+        decrypt(data);
     }
 
   private:
+    /// Fewest blocks handed to a thread by the parallel variants, 64KB of RC6-128
+    static const size_t PARALLEL_MIN_BLOCKS = 4096;
     const size_t BLOCK_SIZE;
     T& cipher;
 };
@@ -1,26 +1,325 @@
 #pragma once
 
-#include <cmath>
+#include <array>
 #include <cstddef>
 #include <cstdio>
 #include <iostream>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "../binops.h"
+#include "../cpu.h"
 #include "../obfuscate.h"
 
+#ifdef ENV_X86
+#include <immintrin.h>
+
+/**
+ * Rotate each 32-bit lane left by the low 5 bits of the matching lane in shift
+ * @param words: lanes to rotate
+ * @param shift: per-lane rotation amounts
+ */
+__attribute__((target("avx2"))) static inline __m256i rol_avx2(__m256i words, __m256i shift)
+{
+    shift = _mm256_and_si256(shift, _mm256_set1_epi32(31));
+    return _mm256_or_si256(_mm256_sllv_epi32(words, shift),
+                           _mm256_srlv_epi32(words, _mm256_sub_epi32(_mm256_set1_epi32(32), shift)));
+}
+
+/**
+ * Rotate each 32-bit lane right by the low 5 bits of the matching lane in shift
+ * @param words: lanes to rotate
+ * @param shift: per-lane rotation amounts
+ */
+__attribute__((target("avx2"))) static inline __m256i ror_avx2(__m256i words, __m256i shift)
+{
+    shift = _mm256_and_si256(shift, _mm256_set1_epi32(31));
+    return _mm256_or_si256(_mm256_srlv_epi32(words, shift),
+                           _mm256_sllv_epi32(words, _mm256_sub_epi32(_mm256_set1_epi32(32), shift)));
+}
+
+/**
+ * Load 8 consecutive RC6-128 blocks, gathering word n of every block into lane n of a/b/c/d
+ * @param blocks: 128 bytes of blocks
+ */
+__attribute__((target("avx2"))) static inline void rc6_load_8_avx2(const u8* blocks, __m256i& a, __m256i& b,
+                                                                   __m256i& c, __m256i& d)
+{
+    const __m256i stride = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+    const int* words = (const int*) blocks;
+    a = _mm256_i32gather_epi32(words, stride, 4);
+    b = _mm256_i32gather_epi32(words + 1, stride, 4);
+    c = _mm256_i32gather_epi32(words + 2, stride, 4);
+    d = _mm256_i32gather_epi32(words + 3, stride, 4);
+}
+
+/**
+ * Store a/b/c/d lanes back as 8 consecutive RC6-128 blocks
+ * @param blocks: 128 bytes to store blocks in
+ */
+__attribute__((target("avx2"))) static inline void rc6_store_8_avx2(u8* blocks, __m256i a, __m256i b,
+                                                                    __m256i c, __m256i d)
+{
+    // Transpose lanes back to blocks: low halves hold blocks 0-3, high halves blocks 4-7
+    const __m256i ab_lo = _mm256_unpacklo_epi32(a, b);
+    const __m256i ab_hi = _mm256_unpackhi_epi32(a, b);
+    const __m256i cd_lo = _mm256_unpacklo_epi32(c, d);
+    const __m256i cd_hi = _mm256_unpackhi_epi32(c, d);
+    const __m256i blocks_04 = _mm256_unpacklo_epi64(ab_lo, cd_lo);
+    const __m256i blocks_15 = _mm256_unpackhi_epi64(ab_lo, cd_lo);
+    const __m256i blocks_26 = _mm256_unpacklo_epi64(ab_hi, cd_hi);
+    const __m256i blocks_37 = _mm256_unpackhi_epi64(ab_hi, cd_hi);
+    __m128i* out = (__m128i*) blocks;
+    _mm_storeu_si128(out + 0, _mm256_castsi256_si128(blocks_04));
+    _mm_storeu_si128(out + 1, _mm256_castsi256_si128(blocks_15));
+    _mm_storeu_si128(out + 2, _mm256_castsi256_si128(blocks_26));
+    _mm_storeu_si128(out + 3, _mm256_castsi256_si128(blocks_37));
+    _mm_storeu_si128(out + 4, _mm256_extracti128_si256(blocks_04, 1));
+    _mm_storeu_si128(out + 5, _mm256_extracti128_si256(blocks_15, 1));
+    _mm_storeu_si128(out + 6, _mm256_extracti128_si256(blocks_26, 1));
+    _mm_storeu_si128(out + 7, _mm256_extracti128_si256(blocks_37, 1));
+}
+
+/**
+ * Encrypt 8 consecutive RC6-128 blocks in place, one block per 32-bit lane
+ * @param blocks: 128 bytes of plaintext blocks
+ * @param schedule: expanded key schedule
+ * @param half_rounds: number of half-rounds
+ */
+__attribute__((target("avx2"))) static void rc6_encrypt_8_avx2(u8* blocks, const u32* schedule,
+                                                               size_t half_rounds)
+{
+    __m256i a, b, c, d;
+    rc6_load_8_avx2(blocks, a, b, c, d);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i lg_w = _mm256_set1_epi32(5);
+
+    b = _mm256_add_epi32(b, _mm256_set1_epi32(schedule[0]));
+    d = _mm256_add_epi32(d, _mm256_set1_epi32(schedule[1]));
+    for (size_t i = 1; i <= half_rounds; i++) {
+        __m256i t = rol_avx2(_mm256_mullo_epi32(b, _mm256_add_epi32(_mm256_add_epi32(b, b), one)), lg_w);
+        __m256i u = rol_avx2(_mm256_mullo_epi32(d, _mm256_add_epi32(_mm256_add_epi32(d, d), one)), lg_w);
+        __m256i a_copy =
+            _mm256_add_epi32(rol_avx2(_mm256_xor_si256(a, t), u), _mm256_set1_epi32(schedule[2 * i]));
+        c = _mm256_add_epi32(rol_avx2(_mm256_xor_si256(c, u), t), _mm256_set1_epi32(schedule[2 * i + 1]));
+        a = b;
+        b = c;
+        c = d;
+        d = a_copy;
+    }
+    a = _mm256_add_epi32(a, _mm256_set1_epi32(schedule[2 * half_rounds + 2]));
+    c = _mm256_add_epi32(c, _mm256_set1_epi32(schedule[2 * half_rounds + 3]));
+    rc6_store_8_avx2(blocks, a, b, c, d);
+
+    // Avoid AVX-SSE transition penalties in the scalar code that follows
+    _mm256_zeroupper();
+}
+
+/**
+ * Gather round key k of each lane's key schedule
+ * @param schedules: expanded key schedules
+ * @param offsets: word offset into schedules of each lane's schedule
+ * @param k: round key index
+ */
+__attribute__((target("avx2"))) static inline __m256i rc6_round_keys_8_avx2(const u32* schedules,
+                                                                            __m256i offsets, size_t k)
+{
+    return _mm256_i32gather_epi32((const int*) schedules + k, offsets, 4);
+}
+
+/**
+ * Encrypt 8 consecutive RC6-128 blocks in place, one block per 32-bit lane, each under its own key schedule
+ * @param blocks: 128 bytes of plaintext blocks
+ * @param schedules: expanded key schedules
+ * @param offsets: word offset into schedules of the schedule for each of the 8 blocks
+ * @param half_rounds: number of half-rounds
+ */
+__attribute__((target("avx2"))) static inline void rc6_encrypt_8_multi_avx2(u8* blocks, const u32* schedules,
+                                                                            const u32* offsets,
+                                                                            size_t half_rounds)
+{
+    __m256i a, b, c, d;
+    rc6_load_8_avx2(blocks, a, b, c, d);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i lg_w = _mm256_set1_epi32(5);
+    const __m256i lanes = _mm256_loadu_si256((const __m256i*) offsets);
+
+    b = _mm256_add_epi32(b, rc6_round_keys_8_avx2(schedules, lanes, 0));
+    d = _mm256_add_epi32(d, rc6_round_keys_8_avx2(schedules, lanes, 1));
+    for (size_t i = 1; i <= half_rounds; i++) {
+        __m256i t = rol_avx2(_mm256_mullo_epi32(b, _mm256_add_epi32(_mm256_add_epi32(b, b), one)), lg_w);
+        __m256i u = rol_avx2(_mm256_mullo_epi32(d, _mm256_add_epi32(_mm256_add_epi32(d, d), one)), lg_w);
+        __m256i a_copy = _mm256_add_epi32(rol_avx2(_mm256_xor_si256(a, t), u),
+                                          rc6_round_keys_8_avx2(schedules, lanes, 2 * i));
+        c = _mm256_add_epi32(rol_avx2(_mm256_xor_si256(c, u), t),
+                             rc6_round_keys_8_avx2(schedules, lanes, 2 * i + 1));
+        a = b;
+        b = c;
+        c = d;
+        d = a_copy;
+    }
+    a = _mm256_add_epi32(a, rc6_round_keys_8_avx2(schedules, lanes, 2 * half_rounds + 2));
+    c = _mm256_add_epi32(c, rc6_round_keys_8_avx2(schedules, lanes, 2 * half_rounds + 3));
+    rc6_store_8_avx2(blocks, a, b, c, d);
+
+    // Avoid AVX-SSE transition penalties in the scalar code that follows
+    _mm256_zeroupper();
+}
+
+/**
+ * Decrypt 8 consecutive RC6-128 blocks in place, one block per 32-bit lane
+ * @param blocks: 128 bytes of encrypted blocks
+ * @param schedule: expanded key schedule
+ * @param half_rounds: number of half-rounds
+ */
+__attribute__((target("avx2"))) static void rc6_decrypt_8_avx2(u8* blocks, const u32* schedule,
+                                                               size_t half_rounds)
+{
+    __m256i a, b, c, d;
+    rc6_load_8_avx2(blocks, a, b, c, d);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i lg_w = _mm256_set1_epi32(5);
+
+    c = _mm256_sub_epi32(c, _mm256_set1_epi32(schedule[2 * half_rounds + 3]));
+    a = _mm256_sub_epi32(a, _mm256_set1_epi32(schedule[2 * half_rounds + 2]));
+    for (size_t i = half_rounds; i >= 1; i--) {
+        __m256i d_copy = d;
+        d = c;
+        c = b;
+        b = a;
+        a = d_copy;
+        __m256i u = rol_avx2(_mm256_mullo_epi32(d, _mm256_add_epi32(_mm256_add_epi32(d, d), one)), lg_w);
+        __m256i t = rol_avx2(_mm256_mullo_epi32(b, _mm256_add_epi32(_mm256_add_epi32(b, b), one)), lg_w);
+        c = _mm256_xor_si256(ror_avx2(_mm256_sub_epi32(c, _mm256_set1_epi32(schedule[2 * i + 1])), t), u);
+        a = _mm256_xor_si256(ror_avx2(_mm256_sub_epi32(a, _mm256_set1_epi32(schedule[2 * i])), u), t);
+    }
+    d = _mm256_sub_epi32(d, _mm256_set1_epi32(schedule[1]));
+    b = _mm256_sub_epi32(b, _mm256_set1_epi32(schedule[0]));
+    rc6_store_8_avx2(blocks, a, b, c, d);
+
+    // Avoid AVX-SSE transition penalties in the scalar code that follows
+    _mm256_zeroupper();
+}
+#endif
+
+/// Binary expansions of e - 2 (P) and the golden ratio - 1 (Q), plus lg(w), per word size
+template<class T> struct RC6Constants;
+
+template<> struct RC6Constants<u32> {
+    static constexpr u32 P = 0xb7e15163;
+    static constexpr u32 Q = 0x9e3779b9;
+    static constexpr int LG_W = 5;
+};
+
+/// Matches the double-precision expansions RC6 has always used for 64-bit words
+template<> struct RC6Constants<u64> {
+    static constexpr u64 P = 0xb7e151628aed2000;
+    static constexpr u64 Q = 0x9e3779b97f4a8000;
+    static constexpr int LG_W = 6;
+};
+
+#if __GNUC__
+#define RC6_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define RC6_ALWAYS_INLINE inline
+#endif
+
+/// RC6 rounds fully unrolled at compile time for a fixed word type and number of half-rounds
+template<class T, size_t HALF_ROUNDS> struct RC6Rounds {
+    /// Length of the key schedule
+    static constexpr size_t SCHEDULE_LEN = 2 * HALF_ROUNDS + 4;
+    static constexpr int LG_W = RC6Constants<T>::LG_W;
+
+    /**
+     * Encrypt block in place
+     * @param block_words: block as four words
+     * @param schedule: expanded key schedule of SCHEDULE_LEN words
+     */
+    static RC6_ALWAYS_INLINE void encrypt(T* block_words, const T* schedule)
+    {
+        T a = block_words[0], b = block_words[1] + schedule[0];
+        T c = block_words[2], d = block_words[3] + schedule[1];
+        encrypt_rounds(a, b, c, d, schedule, make_index_sequence<HALF_ROUNDS>{});
+        block_words[0] = a + schedule[SCHEDULE_LEN - 2];
+        block_words[1] = b;
+        block_words[2] = c + schedule[SCHEDULE_LEN - 1];
+        block_words[3] = d;
+    }
+
+    /**
+     * Decrypt block in place
+     * @param block_words: block as four words
+     * @param schedule: expanded key schedule of SCHEDULE_LEN words
+     */
+    static RC6_ALWAYS_INLINE void decrypt(T* block_words, const T* schedule)
+    {
+        T a = block_words[0] - schedule[SCHEDULE_LEN - 2], b = block_words[1];
+        T c = block_words[2] - schedule[SCHEDULE_LEN - 1], d = block_words[3];
+        decrypt_rounds(a, b, c, d, schedule, make_index_sequence<HALF_ROUNDS>{});
+        block_words[0] = a;
+        block_words[1] = b - schedule[0];
+        block_words[2] = c;
+        block_words[3] = d - schedule[1];
+    }
+
+  private:
+    template<size_t... I>
+    static RC6_ALWAYS_INLINE void encrypt_rounds(T& a, T& b, T& c, T& d, const T* schedule,
+                                                index_sequence<I...>)
+    {
+        (encrypt_round<I + 1>(a, b, c, d, schedule), ...);
+    }
+
+    template<size_t... I>
+    static RC6_ALWAYS_INLINE void decrypt_rounds(T& a, T& b, T& c, T& d, const T* schedule,
+                                                index_sequence<I...>)
+    {
+        (decrypt_round<HALF_ROUNDS - I>(a, b, c, d, schedule), ...);
+    }
+
+    template<size_t I> static RC6_ALWAYS_INLINE void encrypt_round(T& a, T& b, T& c, T& d, const T* schedule)
+    {
+        const T t = rol(b * (2 * b + 1), LG_W);
+        const T u = rol(d * (2 * d + 1), LG_W);
+        const T a_copy = rol((a ^ t), u) + schedule[2 * I];
+        c = rol((c ^ u), t) + schedule[2 * I + 1];
+        a = b;
+        b = c;
+        c = d;
+        d = a_copy;
+    }
+
+    template<size_t I> static RC6_ALWAYS_INLINE void decrypt_round(T& a, T& b, T& c, T& d, const T* schedule)
+    {
+        const T d_copy = d;
+        d = c;
+        c = b;
+        b = a;
+        a = d_copy;
+        const T u = rol(d * (2 * d + 1), LG_W);
+        const T t = rol(b * (2 * b + 1), LG_W);
+        c = ror(c - schedule[2 * I + 1], t) ^ u;
+        a = ror(a - schedule[2 * I], u) ^ t;
+    }
+};
+
 /// Rivest cipher 6 implementation
 template<class T> class RC6 : CipherInterface<T>
 {
   public:
     /// 2040-bit max key length
     const unsigned MAX_KEY_BIT_LEN = 8 * 255;
+    /// Half-rounds with a compile-time unrolled implementation, others use the generic loop
+    static constexpr size_t DEFAULT_HALF_ROUNDS = 20;
+    /// Words in a key schedule for the default number of half-rounds
+    static constexpr size_t SCHEDULE_LEN = RC6Rounds<T, DEFAULT_HALF_ROUNDS>::SCHEDULE_LEN;
 
     /**
      * Constructor for RC6 block cipher.
      * @param r: number of half-rounds
      */
-    RC6(T half_rounds = 20)
+    RC6(T half_rounds = DEFAULT_HALF_ROUNDS)
         : WORD_BIT_LEN(numeric_limits<T>::digits), HALF_ROUNDS(half_rounds),
           DEFAULT_ITERATION_LIMIT(2 * HALF_ROUNDS + 4)
     {
@@ -51,31 +350,211 @@ template<class T> class RC6 : CipherInterface<T>
 #endif
     }
 
+    /**
+     * Constructor for RC6 block cipher with the key schedule expanded up front.
+     * @param key: key bytes
+     * @param r: number of half-rounds
+     */
+    RC6(const vector<u8>& key, T half_rounds = DEFAULT_HALF_ROUNDS) : RC6(half_rounds) { set_key(key); }
+
+    /**
+     * Expand user-supplied key into the cipher's key schedule, so blocks can be
+     * processed with encrypt(block)/decrypt(block) without re-running it per block
+     * @param key: key bytes
+     */
+    void set_key(const vector<u8>& key)
+    {
+        if (!is_default_rounds())
+            expanded_key.resize(DEFAULT_ITERATION_LIMIT);
+        key_schedule(key, schedule());
+    }
+
+    /**
+     * Encrypt block-aligned bytes in place using the key passed to set_key
+     * @param data: plain text blocks to encrypt
+     * @param len: byte length, a multiple of the block size
+     */
+    void encrypt(u8* data, size_t len) { encrypt_blocks(data, len / block_byte_size<T>()); }
+
+    /**
+     * Decrypt block-aligned bytes in place using the key passed to set_key
+     * @param data: encrypted blocks to decrypt
+     * @param len: byte length, a multiple of the block size
+     */
+    void decrypt(u8* data, size_t len) { decrypt_blocks(data, len / block_byte_size<T>()); }
+
+    /**
+     * Encrypt plaintext block using the key passed to set_key
+     * @param block: plain text block to encrypt
+     */
+    void encrypt(vector<u8>& block) { encrypt(block.data(), block.size()); }
+
+    /**
+     * Decrypt encrypted block using the key passed to set_key
+     * @param block: encrypted block to decrypt
+     */
+    void decrypt(vector<u8>& block) { decrypt(block.data(), block.size()); }
+
+    /**
+     * Encrypt consecutive blocks in place using the key passed to set_key
+     * RC6-128 runs 8 blocks at a time on AVX2 CPUs, falling back to one block at a time
+     * @param blocks: block-aligned plaintext
+     * @param count: number of blocks
+     */
+    void encrypt_blocks(u8* blocks, size_t count)
+    {
+        const size_t block_len = block_byte_size<T>();
+        size_t i = 0;
+
+#ifdef ENV_X86
+        if constexpr (is_same<T, u32>::value)
+            if (cpu::has_avx2())
+                for (; i + 8 <= count; i += 8)
+                    rc6_encrypt_8_avx2(blocks + i * block_len, schedule(), HALF_ROUNDS);
+#endif
+
+        for (; i < count; i++)
+            encrypt_block((T*) (blocks + i * block_len), schedule());
+    }
+
+    /**
+     * Decrypt consecutive blocks in place using the key passed to set_key
+     * RC6-128 runs 8 blocks at a time on AVX2 CPUs, falling back to one block at a time
+     * @param blocks: block-aligned ciphertext
+     * @param count: number of blocks
+     */
+    void decrypt_blocks(u8* blocks, size_t count)
+    {
+        const size_t block_len = block_byte_size<T>();
+        size_t i = 0;
+
+#ifdef ENV_X86
+        if constexpr (is_same<T, u32>::value)
+            if (cpu::has_avx2())
+                for (; i + 8 <= count; i += 8)
+                    rc6_decrypt_8_avx2(blocks + i * block_len, schedule(), HALF_ROUNDS);
+#endif
+
+        for (; i < count; i++)
+            decrypt_block((T*) (blocks + i * block_len), schedule());
+    }
+
+    /**
+     * Expand key into a caller-owned schedule of SCHEDULE_LEN words for the multi-key encrypt_blocks
+     * Only valid for the default number of half-rounds
+     * @param key: key bytes
+     * @param schedule: SCHEDULE_LEN words to store the schedule in
+     */
+    void expand_key(const vector<u8>& key, T* schedule) { key_schedule(key, schedule); }
+
+    /**
+     * Encrypt consecutive blocks in place with the default number of half-rounds, each under its own key
+     * Blocks under different keys share the AVX2 lanes, so many short messages still fill the 8-block path
+     * @param blocks: block-aligned plaintext
+     * @param count: number of blocks
+     * @param schedules: key schedules from expand_key
+     * @param offsets: word offset into schedules of the schedule for each block
+     */
+    static void encrypt_blocks(u8* blocks, size_t count, const T* schedules, const u32* offsets)
+    {
+        const size_t block_len = block_byte_size<T>();
+        size_t i = 0;
+
+#ifdef ENV_X86
+        if constexpr (is_same<T, u32>::value)
+            if (cpu::has_avx2())
+                for (; i + 8 <= count; i += 8)
+                    rc6_encrypt_8_multi_avx2(blocks + i * block_len, schedules, offsets + i,
+                                             DEFAULT_HALF_ROUNDS);
+#endif
+
+        for (; i < count; i++)
+            RC6Rounds<T, DEFAULT_HALF_ROUNDS>::encrypt((T*) (blocks + i * block_len), schedules + offsets[i]);
+    }
+
     /**
      * Encrypt plaintext block using user-supplied key
+     * NOTE: Runs the key schedule on every call, prefer set_key/encrypt(block) for multiple blocks
      * @param block: plain text block to encrypt
      * @param key: key bytes
      */
     void encrypt(vector<u8>& block, const vector<u8>& key)
     {
+        // Create schedule
+        // schedule called S in paper
+        vector<T> block_schedule(DEFAULT_ITERATION_LIMIT);
+        key_schedule(key, block_schedule.data());
+        encrypt_block((T*) block.data(), block_schedule.data());
+    }
+
+    /**
+     * Decrypt encrypted block using user-supplied key
+     * NOTE: Runs the key schedule on every call, prefer set_key/decrypt(block) for multiple blocks
+     * @param block: encrypted block to decrypt
+     * @param key: key bytes
+     */
+    void decrypt(vector<u8>& block, const vector<u8>& key)
+    {
+        // Create key schedule
+        vector<T> block_schedule(DEFAULT_ITERATION_LIMIT);
+        key_schedule(key, block_schedule.data());
+        decrypt_block((T*) block.data(), block_schedule.data());
+    }
+
+    virtual size_t block_size() { return sizeof(T); }
+
+#ifndef DEBUG
+  private:
+#endif
+    // word_bit_leng called w in paper
+    /// Word bit-length
+    const T WORD_BIT_LEN;
+    /// Number of half-rounds
+    const T HALF_ROUNDS;
+    /// Default iteration limit for key scheduling
+    const size_t DEFAULT_ITERATION_LIMIT;
+    /// Key schedule expanded by set_key for the default number of half-rounds
+    array<T, RC6Rounds<T, DEFAULT_HALF_ROUNDS>::SCHEDULE_LEN> fixed_key;
+    /// Key schedule expanded by set_key for any other number of half-rounds
+    vector<T> expanded_key;
+
+    /// TODO: Make these variables optionally configurable, see how changing affects confusion/diffusion
+    /// Binary expansion of e - 2
+    static constexpr T P = RC6Constants<T>::P;
+    /// Binary expansion of the golden ratio - 1
+    static constexpr T Q = RC6Constants<T>::Q;
+    /// lg(w), rotation applied to t/u each round
+    static constexpr int LG_W = RC6Constants<T>::LG_W;
+
+    bool is_default_rounds() const { return HALF_ROUNDS == DEFAULT_HALF_ROUNDS; }
+
+    /// Key schedule expanded by set_key
+    T* schedule() { return is_default_rounds() ? fixed_key.data() : expanded_key.data(); }
+
+    /**
+     * Encrypt block in place with an expanded key schedule
+     * @param block_words: block as four words
+     * @param schedule: expanded key schedule
+     */
+    void encrypt_block(T* block_words, const T* schedule)
+    {
+        if (is_default_rounds()) {
+            RC6Rounds<T, DEFAULT_HALF_ROUNDS>::encrypt(block_words, schedule);
+            return;
+        }
+
         // Set up word-sized 'registers'
-        T* block_words = (T*) block.data();
         T& a = block_words[0];
         T& b = block_words[1];
         T& c = block_words[2];
         T& d = block_words[3];
 
-        // Create schedule
-        // schedule called S in paper
-        vector<T> schedule(DEFAULT_ITERATION_LIMIT);
-        key_schedule(key, schedule);
-
         // Encrypt
         b += schedule[0];
         d += schedule[1];
         for (size_t i = 1; i <= HALF_ROUNDS; i++) {
-            T t = rol(b * (2 * b + 1), log2(WORD_BIT_LEN));
-            T u = rol(d * (2 * d + 1), log2(WORD_BIT_LEN));
+            T t = rol(b * (2 * b + 1), LG_W);
+            T u = rol(d * (2 * d + 1), LG_W);
             a = rol((a ^ t), u) + schedule[2 * i];
             c = rol((c ^ u), t) + schedule[2 * i + 1];
             T a_copy = a;
@@ -89,23 +568,23 @@ template<class T> class RC6 : CipherInterface<T>
     }
 
     /**
-     * Decrypt encrypted block using user-supplied key
-     * @param block: encrypted block to decrypt
-     * @param key: key bytes
+     * Decrypt block in place with an expanded key schedule
+     * @param block_words: block as four words
+     * @param schedule: expanded key schedule
      */
-    void decrypt(vector<u8>& block, const vector<u8>& key)
+    void decrypt_block(T* block_words, const T* schedule)
     {
+        if (is_default_rounds()) {
+            RC6Rounds<T, DEFAULT_HALF_ROUNDS>::decrypt(block_words, schedule);
+            return;
+        }
+
         // Set up word-sized 'registers'
-        T* block_words = (T*) block.data();
         T& a = block_words[0];
         T& b = block_words[1];
         T& c = block_words[2];
         T& d = block_words[3];
 
-        // Create key schedule
-        vector<T> schedule(DEFAULT_ITERATION_LIMIT);
-        key_schedule(key, schedule);
-
         // Decrypt
         c -= schedule[DEFAULT_ITERATION_LIMIT - 1];
         a -= schedule[DEFAULT_ITERATION_LIMIT - 2];
@@ -115,8 +594,8 @@ template<class T> class RC6 : CipherInterface<T>
             c = b;
             b = a;
             a = d_copy;
-            T u = rol(d * (2 * d + 1), log2(WORD_BIT_LEN));
-            T t = rol(b * (2 * b + 1), log2(WORD_BIT_LEN));
+            T u = rol(d * (2 * d + 1), LG_W);
+            T t = rol(b * (2 * b + 1), LG_W);
             c = ror(c - schedule[2 * i + 1], t) ^ u;
             a = ror(a - schedule[2 * i], u) ^ t;
         }
@@ -124,31 +603,12 @@ template<class T> class RC6 : CipherInterface<T>
         b -= schedule[0];
     }
 
-    virtual size_t block_size() { return sizeof(T); }
-
-#ifndef DEBUG
-  private:
-#endif
-    // word_bit_leng called w in paper
-    /// Word bit-length
-    const T WORD_BIT_LEN;
-    /// Number of half-rounds
-    const T HALF_ROUNDS;
-    /// Default iteration limit for key scheduling
-    const size_t DEFAULT_ITERATION_LIMIT;
-
-    /// TODO: Make these variables optionally configurable, see how changing affects confusion/diffusion
-    /// Binary expansion of e - 2
-    const T P = T(ceil((M_E - 2) * pow(2, numeric_limits<T>::digits)));
-    /// Binary expansion of the golden ratio - 1
-    const T Q = T(((1.618033988749895 - 1) * pow(2, numeric_limits<T>::digits)));
-
     /**
      * Create key schedule S from user-supplied key
      * @param key: key bytes
      * @param S: destination for key schedule
      */
-    void key_schedule(const vector<u8>& key, vector<T>& schedule)
+    void key_schedule(const vector<u8>& key, T* schedule)
     {
         // Copy key to not modify original
         vector<u8> key_copy = key;
@@ -194,9 +654,11 @@ template<class T> class RC6 : CipherInterface<T>
             A = schedule[schedule_index] = rol(schedule[schedule_index] + A + B, 3);
             B = le_word_key[word_index] = rol(le_word_key[word_index] + A + B, A + B);
 
-            // Wrapped indices for schedule/little endian word key
-            schedule_index = (schedule_index + 1) % DEFAULT_ITERATION_LIMIT;
-            word_index = (word_index + 1) % total_words;
+            // Wrapped indices for schedule/little endian word key, compared rather than divided
+            if (++schedule_index == DEFAULT_ITERATION_LIMIT)
+                schedule_index = 0;
+            if (++word_index == total_words)
+                word_index = 0;
         }
     }
 };
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "types.h"
+
+using namespace std;
+
+/**
+ * Preset dictionary training for small, similarly structured messages
+ *
+ * The corpus is cut into one epoch per dictionary segment, and from each epoch the SEGMENT_SIZE byte segment
+ * whose DMER_SIZE byte substrings occur in the most samples is taken. Substrings of a taken segment stop
+ * counting, so later segments add new content. The most valuable segments go last, nearest the data, where
+ * deflate distances are cheapest and where a window limited codec still sees them.
+ */
+namespace dictionary
+{
+    const size_t DEFAULT_SIZE = 32 * 1024;
+    const size_t SEGMENT_SIZE = 256;
+    const size_t DMER_SIZE = 8;
+
+    inline u64 dmer(const string& corpus, size_t pos)
+    {
+        u64 value = 0;
+        memcpy(&value, corpus.data() + pos, DMER_SIZE);
+        return value;
+    }
+
+    /**
+     * Train a preset dictionary
+     * @param samples: representative messages
+     * @param size: dictionary byte size limit
+     */
+    inline vector<u8> train(const vector<string>& samples, size_t size = DEFAULT_SIZE)
+    {
+        // Number of samples each d-mer occurs in
+        unordered_map<u64, u32> frequency;
+        string corpus;
+        for (const string& sample : samples) {
+            unordered_set<u64> seen;
+            for (size_t i = 0; i + DMER_SIZE <= sample.size(); i++)
+                if (seen.insert(dmer(sample, i)).second)
+                    frequency[dmer(sample, i)]++;
+            corpus += sample;
+        }
+
+        if (corpus.size() < SEGMENT_SIZE)
+            return vector<u8>(corpus.begin(), corpus.begin() + min(size, corpus.size()));
+
+        // Only d-mers shared between samples are worth a place in the dictionary
+        auto score = [&frequency](u64 value) -> u64 {
+            auto it = frequency.find(value);
+            return it != frequency.end() && it->second > 1 ? it->second : 0;
+        };
+
+        struct Segment {
+            u64 score;
+            size_t begin;
+        };
+        vector<Segment> segments;
+        const size_t epochs = max((size_t) 1, min(size, corpus.size()) / SEGMENT_SIZE);
+        const size_t epoch_len = corpus.size() / epochs;
+        const size_t segment_dmers = SEGMENT_SIZE - DMER_SIZE + 1;
+
+        for (size_t epoch = 0; epoch < epochs; epoch++) {
+            const size_t begin = epoch * epoch_len;
+            const size_t end = epoch == epochs - 1 ? corpus.size() : begin + epoch_len;
+
+            // Slide a segment over the epoch, keeping the sum of its d-mer scores
+            u64 window = 0;
+            Segment best{0, begin};
+            for (size_t i = begin; i + DMER_SIZE <= end; i++) {
+                window += score(dmer(corpus, i));
+                if (i >= begin + segment_dmers)
+                    window -= score(dmer(corpus, i - segment_dmers));
+                if (i + 1 >= begin + segment_dmers && window > best.score)
+                    best = {window, i + 1 - segment_dmers};
+            }
+            if (best.score == 0)
+                continue;
+
+            segments.push_back(best);
+            for (size_t i = best.begin; i < best.begin + segment_dmers; i++)
+                frequency.erase(dmer(corpus, i));
+        }
+
+        stable_sort(segments.begin(), segments.end(),
+                    [](const Segment& a, const Segment& b) { return a.score < b.score; });
+        vector<u8> dictionary;
+        for (const Segment& segment : segments)
+            dictionary.insert(dictionary.end(), corpus.begin() + segment.begin,
+                              corpus.begin() + segment.begin + SEGMENT_SIZE);
+        return dictionary;
+    }
+} // namespace dictionary
@@ -1,8 +1,7 @@
 #pragma once
 
-#include <algorithm>
+#include <array>
 #include <cstring>
-#include <set>
 #include <string>
 #include <vector>
 
@@ -13,10 +12,6 @@ using namespace std;
 
 namespace dna64
 {
-    static const string b64_idx = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-                                  "abcdefghijklmnopqrstuvwxyz"
-                                  "0123456789+/"_hidden;
-
     const vector<string> codons = {
         "ATT"_hidden, "ATC"_hidden, "ATA"_hidden, "CTT"_hidden, "CTC"_hidden, "CTA"_hidden, "CTG"_hidden,
         "TTA"_hidden, "TTG"_hidden, "GTT"_hidden, "GTC"_hidden, "GTA"_hidden, "GTG"_hidden, "TTT"_hidden,
@@ -29,109 +24,128 @@ namespace dna64
         "CGC"_hidden, "CGA"_hidden, "CGG"_hidden, "AGA"_hidden, "AGG"_hidden, "TAA"_hidden, "TAG"_hidden,
         "TGA"_hidden};
 
-    string encode(const vector<u8>& bytes)
+    /**
+     * Nucleotides of the two codons encoding every 12-bit value, built from codons on first use
+     */
+    inline const vector<array<char, 6>>& codon_pairs()
     {
-        size_t bytes_len = bytes.size();
-        stringstream encoded;
-
-        int i = 0, j = 0;
-        u8 chunk3b[3], chunk4b[4];
-        int bytes_idx = 0;
-        while (bytes_len--) {
-            chunk3b[i++] = bytes[bytes_idx++];
-
-            if (i == 3) {
-                chunk4b[0] = (chunk3b[0] & 0xfc) >> 2;
-                chunk4b[1] = ((chunk3b[0] & 0x03) << 4) + ((chunk3b[1] & 0xf0) >> 4);
-                chunk4b[2] = ((chunk3b[1] & 0x0f) << 2) + ((chunk3b[2] & 0xc0) >> 6);
-                chunk4b[3] = chunk3b[2] & 0x3f;
-                for (i = 0; i < 4; i++) {
-                    encoded << codons[chunk4b[i]];
-                }
-                i = 0;
+        static const vector<array<char, 6>> pairs = [] {
+            vector<array<char, 6>> table(1 << 12);
+            for (size_t value = 0; value < table.size(); value++) {
+                memcpy(table[value].data(), codons[value >> 6].data(), 3);
+                memcpy(table[value].data() + 3, codons[value & 0x3f].data(), 3);
             }
+            return table;
+        }();
+        return pairs;
+    }
+
+    /**
+     * Encode bytes as codons, one codon per base64 digit without padding
+     * Every 3 input bytes become 4 codons, written as two table lookups of 12 bits each
+     * @param bytes: input
+     */
+    string encode(const vector<u8>& bytes)
+    {
+        const size_t groups = bytes.size() / 3;
+        const size_t tail = bytes.size() % 3;
+        string encoded(groups * 12 + (tail ? (tail + 1) * 3 : 0), '\0');
+
+        const vector<array<char, 6>>& pairs = codon_pairs();
+        const u8* in = bytes.data();
+        char* out = &encoded[0];
+        for (size_t group = 0; group < groups; group++, in += 3, out += 12) {
+            const u32 bits = (u32) in[0] << 16 | (u32) in[1] << 8 | in[2];
+            memcpy(out, pairs[bits >> 12].data(), 6);
+            memcpy(out + 6, pairs[bits & 0xfff].data(), 6);
         }
 
-        if (i) {
-            memset(&chunk3b[i], '\0', 3 - i);
-            chunk4b[0] = (chunk3b[0] & 0xfc) >> 2;
-            chunk4b[1] = ((chunk3b[0] & 0x03) << 4) + ((chunk3b[1] & 0xf0) >> 4);
-            chunk4b[2] = ((chunk3b[1] & 0x0f) << 2) + ((chunk3b[2] & 0xc0) >> 6);
-            chunk4b[3] = chunk3b[2] & 0x3f;
-            for (j = 0; j < i + 1; j++) {
-                encoded << codons[chunk4b[j]];
-            }
+        // A 1 or 2 byte tail is zero padded and takes only the codons it reaches into
+        if (tail) {
+            const u32 bits = (u32) in[0] << 16 | (tail == 2 ? (u32) in[1] << 8 : 0);
+            for (size_t k = 0; k <= tail; k++, out += 3)
+                memcpy(out, codons[(bits >> (18 - 6 * k)) & 0x3f].data(), 3);
         }
 
-        return encoded.str();
+        return encoded;
     }
 
-    string to_b64(const string& str, int len)
+    const u8 INVALID_NUCLEOTIDE = 0xff;
+
+    /**
+     * 2-bit code of every character, A C G T are 0 to 3 and anything else is INVALID_NUCLEOTIDE
+     */
+    constexpr array<u8, 256> nucleotide_codes()
     {
-        int num_substr = str.length() / len;
-        vector<string> split;
-        for (auto i = 0; i <= num_substr; i++)
-            split.push_back(str.substr(i * len, len));
-        set<string> to_replace(split.begin(), split.end());
-        for (const string& codon : to_replace) {
-            string b64_replacement =
-                string(1, b64_idx[distance(codons.begin(), find(codons.begin(), codons.end(), codon))]);
-            replace(split.begin(), split.end(), codon, b64_replacement);
-        }
-        ostringstream os;
-        copy(split.begin(), split.end(), ostream_iterator<string>(os));
-        os.seekp(0, ios::end);
-        // Pad
-        while ((4 - os.tellp() % 4) % 4)
-            os << '=';
-        return os.str();
+        array<u8, 256> codes{};
+        for (u8& code : codes)
+            code = INVALID_NUCLEOTIDE;
+        codes['A'] = 0;
+        codes['C'] = 1;
+        codes['G'] = 2;
+        codes['T'] = 3;
+        return codes;
     }
 
-    inline bool is_b64(char c) { return (isalnum(c) || (c == '+') || (c == '/')); }
+    static constexpr array<u8, 256> NUCLEOTIDE_CODES = nucleotide_codes();
 
-    string b64_decode(string const& encoded)
+    /**
+     * Base64 digit of every codon, indexed by its three nucleotide codes packed 2 bits each,
+     * built from codons on first use
+     */
+    inline const array<u8, 64>& codon_values()
     {
-        int in_len = encoded.size();
-        int i = 0;
-        int j = 0;
-        int in_ = 0;
-        u8 chunk4b[4], chunk3b[3];
-        stringstream ss;
-
-        while (in_len-- && (encoded[in_] != '=') && is_b64(encoded[in_])) {
-            chunk4b[i++] = encoded[in_];
-            in_++;
-            if (i == 4) {
-                for (i = 0; i < 4; i++)
-                    chunk4b[i] = b64_idx.find(chunk4b[i]);
-
-                chunk3b[0] = (chunk4b[0] << 2) + ((chunk4b[1] & 0x30) >> 4);
-                chunk3b[1] = ((chunk4b[1] & 0xf) << 4) + ((chunk4b[2] & 0x3c) >> 2);
-                chunk3b[2] = ((chunk4b[2] & 0x3) << 6) + chunk4b[3];
-
-                for (i = 0; (i < 3); i++)
-                    ss << chunk3b[i];
-                i = 0;
+        static const array<u8, 64> values = [] {
+            array<u8, 64> table{};
+            for (size_t digit = 0; digit < codons.size(); digit++) {
+                const string& codon = codons[digit];
+                table[NUCLEOTIDE_CODES[(u8) codon[0]] << 4 | NUCLEOTIDE_CODES[(u8) codon[1]] << 2 |
+                      NUCLEOTIDE_CODES[(u8) codon[2]]] = digit;
             }
-        }
-
-        if (i) {
-            for (j = i; j < 4; j++)
-                chunk4b[j] = 0;
-
-            for (j = 0; j < 4; j++)
-                chunk4b[j] = b64_idx.find(chunk4b[j]);
-
-            chunk3b[0] = (chunk4b[0] << 2) + ((chunk4b[1] & 0x30) >> 4);
-            chunk3b[1] = ((chunk4b[1] & 0xf) << 4) + ((chunk4b[2] & 0x3c) >> 2);
-            chunk3b[2] = ((chunk4b[2] & 0x3) << 6) + chunk4b[3];
+            return table;
+        }();
+        return values;
+    }
 
-            for (j = 0; (j < i - 1); j++)
-                ss << chunk3b[j];
+    /**
+     * Decode codons back to bytes, every 4 codons become 3 bytes
+     * Decoding stops at the first triple that is not a codon, a partial codon at the end is ignored
+     * @param data: nucleotides
+     */
+    string decode(const string& data)
+    {
+        const array<u8, 64>& values = codon_values();
+        const size_t codon_count = data.size() / 3;
+        string decoded(codon_count / 4 * 3 + 2, '\0');
+
+        const u8* in = (const u8*) data.data();
+        char* out = &decoded[0];
+        u32 bits = 0;
+        size_t digits = 0;
+        for (size_t i = 0; i < codon_count; i++, in += 3) {
+            const u8 a = NUCLEOTIDE_CODES[in[0]];
+            const u8 b = NUCLEOTIDE_CODES[in[1]];
+            const u8 c = NUCLEOTIDE_CODES[in[2]];
+            if ((a | b | c) > 3)
+                break;
+
+            bits = bits << 6 | values[a << 4 | b << 2 | c];
+            if (++digits == 4) {
+                out[0] = (char)(bits >> 16);
+                out[1] = (char)(bits >> 8);
+                out[2] = (char) bits;
+                out += 3;
+                bits = 0;
+                digits = 0;
+            }
         }
 
-        return ss.str();
-    }
+        // 2 or 3 trailing digits carry 1 or 2 bytes, a lone digit carries none
+        bits <<= 6 * (4 - digits);
+        for (size_t k = 0; k + 1 < digits; k++)
+            *out++ = (char)(bits >> (16 - 8 * k));
 
-    string decode(const string& data) { return b64_decode(to_b64(data, 3)); }
+        decoded.resize(out - &decoded[0]);
+        return decoded;
+    }
 }; // namespace dna64
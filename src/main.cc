@@ -1,4 +1,5 @@
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <random>
 #include <regex>
@@ -14,6 +15,7 @@
 #include "crypto/kdf/fastpbkdf2.h"
 #include "crypto/mode/aead.h"
 #include "crypto/mode/ctr.h"
+#include "dictionary.h"
 #include "dna64.h"
 #include "genbank.h"
 #include "obfuscate.h"
@@ -23,7 +25,13 @@
 using namespace std;
 namespace po = boost::program_options;
 
-enum { SUCCESS, ERROR_IN_COMMAND_LINE, ERROR_UNHANDLED_EXCEPTION, INVALID_GENBANK_FILE };
+enum {
+    SUCCESS,
+    ERROR_IN_COMMAND_LINE,
+    ERROR_UNHANDLED_EXCEPTION,
+    INVALID_GENBANK_FILE,
+    INVALID_COMPRESSED_DATA
+};
 
 static void help(const po::options_description& desc)
 {
@@ -31,16 +39,37 @@ static void help(const po::options_description& desc)
     cout << msg << endl << desc << endl;
 }
 
-static void encrypt(vector<u8>& data, const string& password, const string& aad = "")
+/**
+ * Derive the key generating key from the password
+ * @param password: encryption password, also used as salt
+ */
+static vector<u8> derive_key(const string& password)
+{
+    vector<u8> kgk(32);
+    fastpbkdf2_hmac_sha256((u8*) password.data(), password.size(), (u8*) password.data(), password.size(),
+                           15000, kgk.data(), kgk.size());
+    return kgk;
+}
+
+/**
+ * Start deriving the key on a background thread, so it overlaps reading and transforming the input
+ * @param password: encryption password, nothing is derived when empty
+ */
+static future<vector<u8>> derive_key_async(const string& password)
+{
+    if (password == "")
+        return {};
+    return async(launch::async, derive_key, password);
+}
+
+static void encrypt(vector<u8>& data, future<vector<u8>>& key, const string& aad = "")
 {
     string msg = "[*] Encrypting data..."_hidden;
     cerr << msg << endl;
 
     if (aad != "") {
         vector<u8> aad_bytes(aad.begin(), aad.end());
-        vector<u8> kgk(32);
-        fastpbkdf2_hmac_sha256((u8*) password.data(), password.size(), (u8*) password.data(), password.size(),
-                               15000, kgk.data(), kgk.size());
+        vector<u8> kgk = key.get();
         AEAD<WordSize::BLOCK_128> aead(kgk);
         aead.seal(data, aad_bytes, true);
     } else {
@@ -48,11 +77,8 @@ static void encrypt(vector<u8>& data, const string& password, const string& aad
         ECB<RC6<WordSize::BLOCK_128>> ecb(cipher);
         CTR<ECB<RC6<WordSize::BLOCK_128>>> ctr(ecb, block_byte_size<WordSize::BLOCK_128>());
         vector<u8> counter(16);
-        vector<u8> kgk(32);
-        fastpbkdf2_hmac_sha256((u8*) password.data(), password.size(), (u8*) password.data(), password.size(),
-                               15000, kgk.data(), kgk.size());
         size_t padding = pad_to_block_size(data, block_byte_size<WordSize::BLOCK_128>());
-        ctr.crypt_parallel(data, kgk, counter);
+        ctr.crypt_parallel(data, key.get(), counter);
         // Snip padding length
         data.erase(data.end() - padding, data.end());
         // Append tag
@@ -60,16 +86,14 @@ static void encrypt(vector<u8>& data, const string& password, const string& aad
     }
 }
 
-static void decrypt(vector<u8>& data, const string& password, const string& aad = "")
+static void decrypt(vector<u8>& data, future<vector<u8>>& key, const string& aad = "")
 {
     string msg = "[*] Decrypting data..."_hidden;
     cerr << msg << endl;
 
     if (aad != "") {
         vector<u8> aad_bytes(aad.begin(), aad.end());
-        vector<u8> kgk(32);
-        fastpbkdf2_hmac_sha256((u8*) password.data(), password.size(), (u8*) password.data(), password.size(),
-                               15000, kgk.data(), kgk.size());
+        vector<u8> kgk = key.get();
         // Create AEAD using RC6
         AEAD<WordSize::BLOCK_128> aead(kgk);
         aead.open(data, aad_bytes, true);
@@ -79,17 +103,94 @@ static void decrypt(vector<u8>& data, const string& password, const string& aad
         ECB<RC6<WordSize::BLOCK_128>> ecb(cipher);
         CTR<ECB<RC6<WordSize::BLOCK_128>>> ctr(ecb, block_byte_size<WordSize::BLOCK_128>());
         vector<u8> counter(16);
-        vector<u8> kgk(32);
-        fastpbkdf2_hmac_sha256((u8*) password.data(), password.size(), (u8*) password.data(), password.size(),
-                               15000, kgk.data(), kgk.size());
         pad_to_block_size(data, block_byte_size<WordSize::BLOCK_128>());
-        ctr.crypt_parallel(data, kgk, counter);
+        ctr.crypt_parallel(data, key.get(), counter);
+    }
+}
+
+/**
+ * Read a preset compression dictionary
+ * @param dictionary_file: dictionary path, nothing is read when empty
+ */
+static vector<u8> load_dictionary(const string& dictionary_file)
+{
+    if (dictionary_file == "")
+        return {};
+    if (!file_exists(dictionary_file)) {
+        string pre = "ERROR: Dictionary file '"_hidden;
+        string post = "' does not exist.\n"_hidden;
+        cerr << pre << dictionary_file << post;
+        exit(ERROR_IN_COMMAND_LINE);
+    }
+    string dictionary = read_file(dictionary_file);
+    return vector<u8>(dictionary.begin(), dictionary.end());
+}
+
+/**
+ * Train a preset compression dictionary from a corpus of one sample message per line
+ * @param input_file: corpus path
+ * @param output_file: dictionary path
+ */
+static void train_dictionary(const string& input_file, const string& output_file)
+{
+    if (input_file == "" || output_file == "" || !file_exists(input_file)) {
+        string error = "ERROR: Training needs an existing corpus as input and an output file.\n"_hidden;
+        cerr << error;
+        exit(ERROR_IN_COMMAND_LINE);
     }
+
+    vector<string> samples;
+    stringstream corpus(read_file(input_file));
+    for (string line; getline(corpus, line);)
+        if (line != "")
+            samples.push_back(line + "\n");
+
+    vector<u8> trained = dictionary::train(samples);
+    ofstream ofs(output_file, ios_base::out | ios_base::binary);
+    ofs.write(reinterpret_cast<const char*>(trained.data()), trained.size());
+    ofs.close();
+
+    string pre = "[*] Trained a "_hidden;
+    string middle = " byte dictionary from "_hidden;
+    string post = " samples, id "_hidden;
+    cerr << pre << trained.size() << middle << samples.size() << post << hex
+         << compression::dictionary_id(trained) << dec << endl;
+}
+
+/**
+ * Report a missing input file
+ * @param input_file: input path, stdin when empty
+ * @return whether the input can be read
+ */
+static bool input_exists(const string& input_file)
+{
+    if (input_file == "" || file_exists(input_file))
+        return true;
+    string pre = "ERROR: File '"_hidden;
+    string post = "' does not exist.\n"_hidden;
+    cerr << pre << input_file << post;
+    return false;
 }
 
-static void steg_data(const string& password, const string& aad, const string& input_file,
-                      const string& output_file, bool disable_compression)
+/**
+ * Steg a message into a GenBank file
+ * Errors are returned rather than exited on: the key thread must be joined before the process exits,
+ * which the future does as it goes out of scope
+ * @return exit code
+ */
+static int steg_data(const string& password, const string& aad, const string& input_file,
+                     const string& output_file, bool disable_compression, const string& codec, int level,
+                     const vector<u8>& dictionary)
 {
+    const compression::CodecId codec_id = compression::codec_id(codec);
+    if (!disable_compression)
+        level = compression::check_settings(codec_id, level, dictionary);
+    if (!input_exists(input_file))
+        return ERROR_IN_COMMAND_LINE;
+
+    // The key depends only on the password, derive it while the input is read and compressed
+    future<vector<u8>> key = derive_key_async(password);
+
     string data;
     stringstream ss;
     vector<u8> compressed;
@@ -97,17 +198,10 @@ static void steg_data(const string& password, const string& aad, const string& i
     string dna;
 
     if (input_file != "") {
-        if (file_exists(input_file)) {
-            string pre = "[*] File size: "_hidden;
-            string post = " bytes"_hidden;
-            cerr << pre << file_size(input_file.c_str()) << post << endl;
-            data = read_file(input_file);
-        } else {
-            string pre = "ERROR: File '"_hidden;
-            string post = "' does not exist.\n"_hidden;
-            cerr << pre << input_file << post;
-            exit(ERROR_IN_COMMAND_LINE);
-        }
+        string pre = "[*] File size: "_hidden;
+        string post = " bytes"_hidden;
+        cerr << pre << file_size(input_file.c_str()) << post << endl;
+        data = read_file(input_file);
     } else {
         string header = "<<< BEGIN STEGGED MESSAGE (Press CTRL+D when done) >>>\n\n"_hidden;
         string footer = "<<< END STEGGED MESSAGE >>>\n\n"_hidden;
@@ -127,14 +221,18 @@ static void steg_data(const string& password, const string& aad, const string& i
     if (!disable_compression) {
         string compressing = "[*] Compressing..."_hidden;
         cerr << compressing << endl;
-        lzma::compress(data, compressed);
+        compression::CodecId used = compression::compress(data, compressed, codec_id, level, dictionary);
+        if (used == compression::CodecId::STORED) {
+            string stored = "[*] Input is incompressible, storing it uncompressed"_hidden;
+            cerr << stored << endl;
+        }
     }
 
     if (password != "") {
         if (aad != "")
-            encrypt(encrypted = disable_compression ? input_data : compressed, password, aad);
+            encrypt(encrypted = disable_compression ? input_data : compressed, key, aad);
         else
-            encrypt(encrypted = disable_compression ? input_data : compressed, password);
+            encrypt(encrypted = disable_compression ? input_data : compressed, key);
     }
 
     string encoding = "[*] Encoding DNA..."_hidden;
@@ -149,22 +247,27 @@ static void steg_data(const string& password, const string& aad, const string& i
     } else {
         cout << endl << dna << endl;
     }
+    return SUCCESS;
 }
 
-static void unsteg_data(const string& password, const string& aad, const string& input_file,
-                        const string& output_file, bool disable_compression)
+/**
+ * Recover a message stegged into a GenBank file
+ * Errors are returned rather than exited on, for the same reason as in steg_data
+ * @return exit code
+ */
+static int unsteg_data(const string& password, const string& aad, const string& input_file,
+                       const string& output_file, bool disable_compression, const vector<u8>& dictionary)
 {
+    if (!input_exists(input_file))
+        return ERROR_IN_COMMAND_LINE;
+
+    // The key depends only on the password, derive it while the DNA is read and decoded
+    future<vector<u8>> key = derive_key_async(password);
+
     string data = "";
 
     if (input_file != "") {
-        if (file_exists(input_file)) {
-            data = read_file(input_file);
-        } else {
-            string pre = "ERROR: File '"_hidden;
-            string post = "' does not exist.\n"_hidden;
-            cerr << pre << input_file << post;
-            exit(ERROR_IN_COMMAND_LINE);
-        }
+        data = read_file(input_file);
     } else {
         string header = "<<< BEGIN DNA SEQUENCE MESSAGE (Press CTRL+D when done) >>>\n\n"_hidden;
         string footer = "<<< END DNA SEQUENCE MESSAGE >>>\n\n"_hidden;
@@ -178,30 +281,32 @@ static void unsteg_data(const string& password, const string& aad, const string&
     cerr << decoding << endl;
     string dna = parse_dna(data);
     if (dna.size() == 0)
-        exit(INVALID_GENBANK_FILE);
+        return INVALID_GENBANK_FILE;
     string decoded = dna64::decode(dna);
     vector<u8> decrypted(decoded.begin(), decoded.end());
 
     if (password != "") {
         if (aad != "")
-            decrypt(decrypted, password, aad);
+            decrypt(decrypted, key, aad);
         else
-            decrypt(decrypted, password);
+            decrypt(decrypted, key);
     }
 
-    size_t decompressed_size = 0;
     vector<u8> decompressed;
     if (!disable_compression) {
         string decompressing = "[*] Decompressing data..."_hidden;
         cerr << decompressing << endl;
-        decompressed = vector<u8>(decrypted.size() * 4);
-        decompressed_size = lzma::decompress(decrypted, decompressed);
+        if (!compression::decompress(decrypted, decompressed, dictionary)) {
+            string error = "ERROR: Decompression failed, data is corrupt or was not compressed.\n"_hidden;
+            cerr << error;
+            return INVALID_COMPRESSED_DATA;
+        }
     }
 
     if (output_file != "") {
         ofstream ofs(output_file, ios_base::out | ios_base::binary);
         if (!disable_compression)
-            ofs.write(reinterpret_cast<const char*>(decompressed.data()), decompressed_size);
+            ofs.write(reinterpret_cast<const char*>(decompressed.data()), decompressed.size());
         else
             ofs.write(reinterpret_cast<const char*>(decrypted.data()), decrypted.size());
         ofs.close();
@@ -210,11 +315,12 @@ static void unsteg_data(const string& password, const string& aad, const string&
         string footer = "<<< END RECOVERED MESSAGE >>>"_hidden;
         cerr << endl << header << endl << endl;
         if (!disable_compression)
-            cout.write(reinterpret_cast<const char*>(decompressed.data()), decompressed_size);
+            cout.write(reinterpret_cast<const char*>(decompressed.data()), decompressed.size());
         else
             cout.write(reinterpret_cast<const char*>(decrypted.data()), decrypted.size());
         cerr << endl << footer << endl;
     }
+    return SUCCESS;
 }
 
 int main(int argc, char** argv)
@@ -225,6 +331,10 @@ int main(int argc, char** argv)
     string input_file = "";
     string aad = "";
     bool disable_compression = false;
+    string codec = "deflate"_hidden;
+    int level = compression::DEFAULT_LEVEL;
+    string dictionary_file = "";
+    bool train = false;
 
     try {
         string options = "dnahide options"_hidden;
@@ -236,6 +346,14 @@ int main(int argc, char** argv)
         string aad_switches = "aad,a"_hidden, aad_message = "additional authenticated data"_hidden;
         string disable_compression_switches = "disable-compression"_hidden,
                disable_compression_message = "disable compression"_hidden;
+        string codec_switches = "codec"_hidden,
+               codec_message = "compression codec: deflate, lzma or zstd"_hidden;
+        string level_switches = "level"_hidden,
+               level_message = "compression level, codec default if unset"_hidden;
+        string dictionary_switches = "dictionary"_hidden,
+               dictionary_message = "preset compression dictionary file"_hidden;
+        string train_switches = "train"_hidden,
+               train_message = "train a dictionary from input samples, one per line, into the output"_hidden;
 
         po::options_description desc(options);
         // clang-format off
@@ -245,7 +363,11 @@ int main(int argc, char** argv)
             output_switches.c_str(), po::value(&output_file), output_message.c_str())(
             pass_switches.c_str(), po::value(&password), pass_message.c_str())(
             aad_switches.c_str(), po::value(&aad), aad_message.c_str())(
-            disable_compression_switches.c_str(), po::bool_switch(&disable_compression), disable_compression_message.c_str());
+            disable_compression_switches.c_str(), po::bool_switch(&disable_compression), disable_compression_message.c_str())(
+            codec_switches.c_str(), po::value(&codec), codec_message.c_str())(
+            level_switches.c_str(), po::value(&level), level_message.c_str())(
+            dictionary_switches.c_str(), po::value(&dictionary_file), dictionary_message.c_str())(
+            train_switches.c_str(), po::bool_switch(&train), train_message.c_str());
         // clang-format on
 
         po::variables_map vm;
@@ -260,10 +382,14 @@ int main(int argc, char** argv)
 
             po::notify(vm);
 
-            if (unsteg)
-                unsteg_data(password, aad, input_file, output_file, disable_compression);
+            if (train)
+                train_dictionary(input_file, output_file);
+            else if (unsteg)
+                return unsteg_data(password, aad, input_file, output_file, disable_compression,
+                                   load_dictionary(dictionary_file));
             else
-                steg_data(password, aad, input_file, output_file, disable_compression);
+                return steg_data(password, aad, input_file, output_file, disable_compression, codec, level,
+                                 load_dictionary(dictionary_file));
         } catch (po::error& e) {
             string pre = "ERROR: "_hidden;
             cerr << pre << e.what() << endl << endl;
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+#include "threadpool.h"
+
+using namespace std;
+
+namespace parallel
+{
+    /**
+     * Process-wide cap on the threads used by calls that set none of their own, 0 for the whole shared pool
+     * Lets throughput be measured against the number of cores
+     */
+    inline atomic<size_t>& worker_limit()
+    {
+        static atomic<size_t> limit{0};
+        return limit;
+    }
+
+    /**
+     * Split [0, count) into contiguous ranges, one per pool thread, and run body on each concurrently
+     * Runs body inline when the work is too small to be worth more than one range
+     * @param count: number of items
+     * @param min_range: fewest items worth handing to a thread
+     * @param body: called with [begin, end) item ranges
+     * @param max_workers: cap on threads used, 0 for worker_limit()
+     */
+    inline void for_each_range(size_t count, size_t min_range, const function<void(size_t, size_t)>& body,
+                               size_t max_workers = 0)
+    {
+        ThreadPool& pool = ThreadPool::shared();
+        if (!max_workers)
+            max_workers = worker_limit();
+        size_t workers = max_workers ? min(max_workers, pool.concurrency()) : pool.concurrency();
+        workers = min(workers, max((size_t) 1, count / max(min_range, (size_t) 1)));
+
+        if (workers <= 1) {
+            body(0, count);
+            return;
+        }
+
+        const size_t range = (count + workers - 1) / workers;
+        pool.run((count + range - 1) / range,
+                 [&body, range, count](size_t i) { body(i * range, min((i + 1) * range, count)); });
+    }
+} // namespace parallel
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/// Persistent worker threads shared by the parallel code paths
+class ThreadPool
+{
+  public:
+    /**
+     * Constructor for ThreadPool
+     * @param thread_count: number of worker threads to start
+     */
+    explicit ThreadPool(size_t thread_count)
+    {
+        for (size_t i = 0; i < thread_count; i++)
+            workers.emplace_back([this] { work(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(jobs_mutex);
+            stopping = true;
+        }
+        jobs_available.notify_all();
+
+        for (thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Process-wide pool, the calling thread of run() makes up the last hardware thread
+     */
+    static ThreadPool& shared()
+    {
+        static ThreadPool pool(max(1u, thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    /// Number of threads run() can use, including the caller
+    size_t concurrency() const { return workers.size() + 1; }
+
+    /**
+     * Run task(0) .. task(task_count - 1) on the pool and the calling thread, returning when all are done
+     * Safe to call from inside a task: the caller keeps taking tasks itself instead of waiting on workers
+     * @param task_count: number of tasks
+     * @param task: called once with each task index
+     */
+    void run(size_t task_count, const function<void(size_t)>& task)
+    {
+        if (task_count == 0)
+            return;
+
+        auto batch = make_shared<Batch>(task_count, task);
+        const size_t helpers = min(workers.size(), task_count - 1);
+        if (helpers) {
+            {
+                lock_guard<mutex> lock(jobs_mutex);
+                for (size_t i = 0; i < helpers; i++)
+                    jobs.push([batch] { batch->drain(); });
+            }
+            helpers == 1 ? jobs_available.notify_one() : jobs_available.notify_all();
+        }
+
+        batch->drain();
+
+        unique_lock<mutex> lock(batch->done_mutex);
+        batch->all_done.wait(lock, [&batch] { return batch->done == batch->count; });
+
+        // Surface the first task failure on the calling thread
+        if (batch->error)
+            rethrow_exception(batch->error);
+    }
+
+  private:
+    /// Tasks of one run() call, kept alive by any queued helper that has not started yet
+    struct Batch {
+        Batch(size_t count, const function<void(size_t)>& task) : count(count), task(task) {}
+
+        /// Take and run task indices until none are left
+        void drain()
+        {
+            size_t finished = 0;
+            exception_ptr failure;
+            for (size_t i = next++; i < count; i = next++, finished++) {
+                try {
+                    task(i);
+                } catch (...) {
+                    if (!failure)
+                        failure = current_exception();
+                }
+            }
+
+            if (finished) {
+                lock_guard<mutex> lock(done_mutex);
+                if (failure && !error)
+                    error = failure;
+                done += finished;
+                if (done == count)
+                    all_done.notify_all();
+            }
+        }
+
+        const size_t count;
+        const function<void(size_t)>& task;
+        atomic<size_t> next{0};
+        size_t done = 0;
+        exception_ptr error;
+        mutex done_mutex;
+        condition_variable all_done;
+    };
+
+    vector<thread> workers;
+    queue<function<void()>> jobs;
+    mutex jobs_mutex;
+    condition_variable jobs_available;
+    bool stopping = false;
+
+    void work()
+    {
+        for (;;) {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(jobs_mutex);
+                jobs_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
@@ -25,10 +25,16 @@ namespace WordSize
 template<class T> class CipherInterface
 {
   public:
+    virtual void set_key(const vector<u8>& key) = 0;
+    /// In place over block-aligned bytes with the key passed to set_key, must not allocate
+    virtual void encrypt(u8* data, size_t len) = 0;
+    virtual void decrypt(u8* data, size_t len) = 0;
+    virtual void encrypt(vector<u8>& data) = 0;
+    virtual void decrypt(vector<u8>& data) = 0;
     virtual void encrypt(vector<u8>& data, const vector<u8>& key) = 0;
     virtual void decrypt(vector<u8>& data, const vector<u8>& key) = 0;
 
     virtual size_t block_size() { return sizeof(T); }
 };
 
-template<class T> static inline size_t block_byte_size() { return sizeof(T) * 4; }
+template<class T> static constexpr size_t block_byte_size() { return sizeof(T) * 4; }
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
 #include <vector>
 
+#include "obfuscate.h"
+#include "types.h"
+
 using namespace std;
 
 template<typename T> ostream& operator<<(ostream& output, vector<T> const& values)
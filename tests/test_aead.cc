@@ -0,0 +1,154 @@
+#define BOOST_TEST_MODULE aead
+#include <boost/test/included/unit_test.hpp>
+
+// Reach the nonce-taking seal and the batch group helpers
+#define DEBUG
+
+#include <string>
+#include <vector>
+
+#include "crypto/mode/aead.h"
+
+using namespace std;
+
+typedef AEAD<WordSize::BLOCK_128> Aead;
+
+/// Plaintext, AAD and the ciphertext || tag the original implementation sealed them to
+struct Vector {
+    string plaintext;
+    string aad;
+    string sealed_hex;
+};
+
+/**
+ * Known answers under key 00 01 .. 1f and nonce a0 a1 .. ab, pinned to the output of the original
+ * pad_to_block_size implementation: an empty plaintext or AAD is hashed as one zero block
+ */
+static const vector<Vector> VECTORS = {
+    {"", "", "f2597f461495a9f28e2f8605435e8fa6"},
+    {"", "ad", "65270c04b6f6656b360dd564d54728b1"},
+    {"hello", "", "01c9ef26bca750c57ab549adb28cf5da03d02a7e28"},
+    {"hello", "ad", "ce97620216d56454b3314ac94821e29a362ca59f11"},
+    {"0123456789abcdef", "0123456789abcdef",
+     "f55b9d86974daaa8a5d43e58f729a0d5ac0e4ee1544508e01fdf6ac66f5a807f"},
+    {"0123456789abcdef0123", "",
+     "7c2f0f9200d2f97ff3b11fbf42625686950c6b3774ba734ef8724af4e9e10bf6c6cfb18b"},
+};
+
+static vector<u8> bytes(const string& s) { return vector<u8>(s.begin(), s.end()); }
+
+static string hex(const u8* data, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    string out;
+    for (size_t i = 0; i < len; i++) {
+        out += digits[data[i] >> 4];
+        out += digits[data[i] & 0xf];
+    }
+    return out;
+}
+
+static vector<u8> key()
+{
+    vector<u8> kgk(32);
+    for (size_t i = 0; i < kgk.size(); i++)
+        kgk[i] = (u8) i;
+    return kgk;
+}
+
+static vector<u8> nonce()
+{
+    vector<u8> n(12);
+    for (size_t i = 0; i < n.size(); i++)
+        n[i] = (u8)(0xa0 + i);
+    return n;
+}
+
+BOOST_AUTO_TEST_CASE(seal_matches_known_answers)
+{
+    const vector<u8> kgk = key();
+    Aead aead(kgk);
+    for (const Vector& v : VECTORS) {
+        vector<u8> data = bytes(v.plaintext);
+        aead.seal(data, bytes(v.aad), nonce(), false);
+        BOOST_TEST(hex(data.data(), data.size()) == v.sealed_hex);
+
+        aead.open(data, bytes(v.aad), nonce(), false);
+        BOOST_TEST(data == bytes(v.plaintext));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(batch_seal_matches_known_answers)
+{
+    const vector<u8> kgk = key();
+    Aead aead(kgk);
+    vector<vector<u8>> messages;
+    vector<vector<u8>> aads;
+    vector<u8> nonces;
+    for (const Vector& v : VECTORS) {
+        messages.push_back(bytes(v.plaintext));
+        aads.push_back(bytes(v.aad));
+        const vector<u8> n = nonce();
+        nonces.insert(nonces.end(), n.begin(), n.end());
+    }
+
+    aead.seal_group(messages, aads, nonces.data(), 0, messages.size());
+    for (size_t i = 0; i < VECTORS.size(); i++)
+        BOOST_TEST(hex(messages[i].data() + 12, messages[i].size() - 12) == VECTORS[i].sealed_hex);
+
+    aead.open(messages, aads, false);
+    for (size_t i = 0; i < VECTORS.size(); i++)
+        BOOST_TEST(messages[i] == bytes(VECTORS[i].plaintext));
+}
+
+BOOST_AUTO_TEST_CASE(empty_message_tag_is_checked)
+{
+    const vector<u8> kgk = key();
+    Aead aead(kgk);
+    vector<u8> data;
+    aead.seal(data, {}, true);
+    data.back() ^= 1;
+    BOOST_CHECK_THROW(aead.open(data, {}, true), runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(block_256_round_trips_partial_blocks)
+{
+    // 32-byte Polyval blocks, so these AAD and message lengths all leave a partial trailing block
+    const vector<u8> kgk = key();
+    AEAD<WordSize::BLOCK_256> aead(kgk);
+    for (size_t aad_len : {1, 17, 31, 33, 95})
+        for (size_t len : {0, 5, 31, 47, 1000}) {
+            vector<u8> aad(aad_len), plaintext(len);
+            for (size_t i = 0; i < aad_len; i++)
+                aad[i] = (u8)(3 * i + 1);
+            for (size_t i = 0; i < len; i++)
+                plaintext[i] = (u8)(7 * i);
+
+            vector<u8> data = plaintext;
+            aead.seal(data, aad, false);
+            aead.open(data, aad, false);
+            BOOST_TEST(data == plaintext);
+
+            aead.seal(data, aad, false);
+            data.back() ^= 1;
+            BOOST_CHECK_THROW(aead.open(data, aad, false), runtime_error);
+        }
+}
+
+BOOST_AUTO_TEST_CASE(single_and_batch_seal_draw_fresh_nonces)
+{
+    const vector<u8> kgk = key();
+    Aead aead(kgk);
+    const vector<u8> plaintext = bytes("same message");
+
+    vector<u8> first = plaintext;
+    vector<u8> second = plaintext;
+    aead.seal(first, {}, false);
+    aead.seal(second, {}, false);
+    BOOST_TEST(!equal(first.begin(), first.begin() + 12, second.begin()));
+
+    vector<vector<u8>> batch = {plaintext, plaintext};
+    aead.seal(batch, {{}, {}}, false);
+    BOOST_TEST(!equal(batch[0].begin(), batch[0].begin() + 12, batch[1].begin()));
+    BOOST_TEST(!equal(batch[0].begin(), batch[0].begin() + 12, first.begin()));
+}
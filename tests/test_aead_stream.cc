@@ -0,0 +1,116 @@
+#define BOOST_TEST_MODULE aead_stream
+#include <boost/test/included/unit_test.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "crypto/mode/aead_stream.h"
+
+using namespace std;
+
+typedef StreamAEAD<WordSize::BLOCK_128> Stream;
+
+// Its AEAD keeps a reference to the stream's own key, which a copy or move would leave behind
+static_assert(!is_copy_constructible<Stream>::value && !is_move_constructible<Stream>::value, "");
+static_assert(!is_copy_assignable<Stream>::value && !is_move_assignable<Stream>::value, "");
+
+static const vector<u8> KEY(32, 0x5c);
+static const vector<u8> AAD = {'a', 'd'};
+/// Small segments so a few hundred bytes span several of them
+static const size_t SEGMENT = 64;
+static const size_t TAG = 16;
+/// Nonce prefix and segment size in front of the first segment
+static const size_t HEADER = 7 + 4;
+
+static vector<u8> message(size_t len)
+{
+    vector<u8> bytes(len);
+    for (size_t i = 0; i < len; i++)
+        bytes[i] = (u8)(i * 31 + 7);
+    return bytes;
+}
+
+static vector<u8> seal(const vector<u8>& plaintext)
+{
+    Stream stream(KEY, SEGMENT);
+    vector<u8> sealed(plaintext);
+    stream.seal(sealed, AAD);
+    return sealed;
+}
+
+BOOST_AUTO_TEST_CASE(buffer_round_trip)
+{
+    for (size_t len : {0, 1, 63, 64, 65, 3 * 64 + 5}) {
+        const vector<u8> plaintext = message(len);
+        vector<u8> sealed = seal(plaintext);
+        const size_t segments = max((size_t) 1, (len + SEGMENT - 1) / SEGMENT);
+        BOOST_TEST(sealed.size() == HEADER + len + segments * TAG);
+
+        Stream(KEY, SEGMENT).open(sealed, AAD);
+        BOOST_TEST(sealed == plaintext);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stream_round_trip_matches_buffer_format)
+{
+    const vector<u8> plaintext = message(5 * 64 + 17);
+    Stream stream(KEY, SEGMENT);
+
+    istringstream in(string(plaintext.begin(), plaintext.end()));
+    ostringstream sealed;
+    stream.seal(in, sealed, AAD);
+
+    // Stream-sealed bytes open as a buffer and the other way around
+    const string bytes = sealed.str();
+    vector<u8> buffer(bytes.begin(), bytes.end());
+    stream.open(buffer, AAD);
+    BOOST_TEST(buffer == plaintext);
+
+    const vector<u8> buffer_sealed = seal(plaintext);
+    istringstream sealed_in(string(buffer_sealed.begin(), buffer_sealed.end()));
+    ostringstream opened;
+    stream.open(sealed_in, opened, AAD);
+    BOOST_TEST(opened.str() == string(plaintext.begin(), plaintext.end()));
+}
+
+BOOST_AUTO_TEST_CASE(tampered_segment_wipes_buffer)
+{
+    vector<u8> sealed = seal(message(4 * 64));
+    sealed[HEADER + 2 * (SEGMENT + TAG) + 3] ^= 1;
+
+    BOOST_CHECK_THROW(Stream(KEY, SEGMENT).open(sealed, AAD), runtime_error);
+    BOOST_TEST(all_of(sealed.begin(), sealed.end(), [](u8 b) { return b == 0; }));
+}
+
+BOOST_AUTO_TEST_CASE(reordered_segments_fail)
+{
+    vector<u8> sealed = seal(message(4 * 64));
+    swap_ranges(sealed.begin() + HEADER, sealed.begin() + HEADER + SEGMENT + TAG,
+                sealed.begin() + HEADER + SEGMENT + TAG);
+    BOOST_CHECK_THROW(Stream(KEY, SEGMENT).open(sealed, AAD), runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(truncated_stream_fails)
+{
+    // Dropping the last segment leaves a full segment that was not sealed as the last one
+    vector<u8> sealed = seal(message(3 * 64 + 10));
+    sealed.resize(HEADER + 3 * (SEGMENT + TAG));
+    BOOST_CHECK_THROW(Stream(KEY, SEGMENT).open(sealed, AAD), runtime_error);
+
+    vector<u8> header_only(sealed.begin(), sealed.begin() + HEADER - 1);
+    BOOST_CHECK_THROW(Stream(KEY, SEGMENT).open(header_only, AAD), runtime_error);
+
+    istringstream in(string(sealed.begin(), sealed.end()));
+    ostringstream out;
+    BOOST_CHECK_THROW(Stream(KEY, SEGMENT).open(in, out, AAD), runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(bad_segment_sizes_throw)
+{
+    vector<u8> sealed = seal(message(100));
+    BOOST_CHECK_THROW(Stream(KEY, 2 * SEGMENT).open(sealed, AAD), runtime_error);
+    BOOST_CHECK_THROW(Stream(KEY, 0), runtime_error);
+}
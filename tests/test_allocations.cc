@@ -0,0 +1,86 @@
+#define BOOST_TEST_MODULE allocations
+#include <boost/test/included/unit_test.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "crypto/mode/aead.h"
+
+/**
+ * The per-block paths of the ciphers and modes work in place and must not allocate: a counting global
+ * operator new checks the block loops allocate nothing, and AEAD seal/open allocate the same few times
+ * whatever the message size
+ */
+
+using namespace std;
+
+static atomic<size_t> allocations{0};
+
+void* operator new(size_t size)
+{
+    allocations++;
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+/// Allocations made by body
+template<class F> static size_t count_allocations(F body)
+{
+    const size_t before = allocations;
+    body();
+    return allocations - before;
+}
+
+static const vector<u8> KEY(16, 0x2a);
+
+BOOST_AUTO_TEST_CASE(rc6_blocks_do_not_allocate)
+{
+    RC6<WordSize::BLOCK_128> cipher(KEY);
+    vector<u8> data(64 * 1024, 1);
+
+    BOOST_TEST(count_allocations([&] { cipher.encrypt(data.data(), data.size()); }) == 0u);
+    BOOST_TEST(count_allocations([&] { cipher.decrypt(data.data(), data.size()); }) == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(ecb_and_ctr_blocks_do_not_allocate)
+{
+    RC6<WordSize::BLOCK_128> cipher(KEY);
+    ECB<RC6<WordSize::BLOCK_128>> ecb(cipher);
+    CTR<ECB<RC6<WordSize::BLOCK_128>>> ctr(ecb, 16);
+    vector<u8> data(64 * 1024 + 5, 1);
+    const vector<u8> tag(16, 9);
+
+    BOOST_TEST(count_allocations([&] { ecb.encrypt(data.data(), data.size() & ~(size_t) 15); }) == 0u);
+    BOOST_TEST(count_allocations([&] { ctr.crypt(data.data(), data.size(), tag.data()); }) == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(aead_allocations_do_not_grow_with_message)
+{
+    AEAD<WordSize::BLOCK_128> aead(KEY);
+    const vector<u8> aad(20, 7);
+
+    // Allocations of sealing and opening a message of len bytes in a caller buffer
+    auto seal_open = [&](size_t len) {
+        vector<u8> buffer(aead.headroom() + len + aead.tailroom(), 3);
+        size_t opened = 0;
+        const size_t count = count_allocations([&] {
+            const size_t sealed = aead.seal(buffer.data(), len, aad, false);
+            opened = aead.open(buffer.data(), sealed, aad, false);
+        });
+        BOOST_TEST(opened == len);
+        return count;
+    };
+
+    // Warm up the lazily detected CPU features
+    seal_open(16);
+    const size_t small = seal_open(1024);
+    BOOST_TEST(small > 0u);
+    BOOST_TEST(seal_open(1024 * 1024 + 3) == small);
+}
@@ -0,0 +1,99 @@
+#define BOOST_TEST_MODULE compression
+#include <boost/test/included/unit_test.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "compression.h"
+
+/**
+ * Round trips through every codec compiled into this build, and the payload header choices around them:
+ * stored incompressible input, preset dictionaries, and bare deflate payloads from before codecs
+ */
+
+using namespace std;
+using namespace compression;
+
+static const vector<CodecId> CODECS = {
+    CodecId::DEFLATE,
+#ifdef WITH_LZMA
+    CodecId::LZMA,
+#endif
+#ifdef WITH_ZSTD
+    CodecId::ZSTD,
+#endif
+};
+
+/// Repetitive text of len bytes, the same for every run
+static string text(size_t len)
+{
+    mt19937 rng(3);
+    string out;
+    while (out.size() < len)
+        out += "session " + to_string(rng() % 1000) + " sent " + to_string(rng() % 100) + " packets\n";
+    out.resize(len);
+    return out;
+}
+
+static string round_trip(const vector<u8>& payload, const vector<u8>& dictionary = {})
+{
+    vector<u8> restored;
+    BOOST_REQUIRE(decompress(payload, restored, dictionary));
+    return string(restored.begin(), restored.end());
+}
+
+BOOST_AUTO_TEST_CASE(every_codec_round_trips)
+{
+    // One deflate stream, and the block format over several chains
+    for (CodecId id : CODECS)
+        for (size_t len : {0, 1000, 3 * 1024 * 1024 + 7}) {
+            const string message = text(len);
+            vector<u8> payload;
+            const CodecId used = compress(message, payload, id);
+            BOOST_TEST((used == id || !len));
+            BOOST_TEST(round_trip(payload) == message);
+        }
+}
+
+BOOST_AUTO_TEST_CASE(random_input_is_stored)
+{
+    mt19937 rng(5);
+    string message(256 * 1024, '\0');
+    for (char& c : message)
+        c = (char) rng();
+
+    for (CodecId id : CODECS) {
+        vector<u8> payload;
+        BOOST_TEST((compress(message, payload, id) == CodecId::STORED));
+        BOOST_TEST(round_trip(payload) == message);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dictionary_round_trips)
+{
+    const string sample = text(4096);
+    const vector<u8> dictionary(sample.begin(), sample.end());
+    const string message = text(200);
+
+    for (CodecId id : CODECS) {
+        if (!codec(id).supports_dictionary())
+            continue;
+        vector<u8> plain, primed;
+        compress(message, plain, id);
+        BOOST_TEST((compress(message, primed, id, DEFAULT_LEVEL, dictionary) == id));
+        BOOST_TEST((primed[1] & DICTIONARY_FLAG));
+        BOOST_TEST(primed.size() < plain.size());
+        BOOST_TEST(round_trip(primed, dictionary) == message);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bare_deflate_payload_decompresses)
+{
+    const string message = text(5000);
+    vector<u8> payload(compressBound(message.size()));
+    uLongf len = payload.size();
+    BOOST_REQUIRE(compress2(payload.data(), &len, (const u8*) message.data(), message.size(), 9) == Z_OK);
+    payload.resize(len);
+    BOOST_TEST(round_trip(payload) == message);
+}
@@ -0,0 +1,204 @@
+#define BOOST_TEST_MODULE pbkdf2
+#include <boost/test/included/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+#include <openssl/evp.h>
+
+#include "crypto/kdf/fastpbkdf2.h"
+#include "types.h"
+
+/**
+ * PBKDF2-HMAC-SHA256 known answers on every implementation the host can run: SHA-NI where present,
+ * the OpenSSL fallback with the SHA extensions hidden, and the multi-input entry point on each of them
+ * and on the eight AVX2 lanes
+ */
+
+using namespace std;
+
+/// Password, salt, iterations and derived key
+struct Vector {
+    string password;
+    string salt;
+    u32 iterations;
+    string key_hex;
+};
+
+/// RFC 7914 section 11 and the widely published RFC 6070 style SHA-256 vectors
+static const vector<Vector> VECTORS = {
+    {"password", "salt", 1, "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b"},
+    {"password", "salt", 2, "ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43"},
+    {"password", "salt", 4096, "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a"},
+    {"passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096,
+     "348c89dbcbd32b2f32d814b8116e84cf2b17347ebc1800181c4e2a1fb8dd53e1c635518c7dac47e9"},
+    {string("pass\0word", 9), string("sa\0lt", 5), 4096, "89b69d0516f829893c696226650a8687"},
+    {"passwd", "salt", 1,
+     "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"
+     "49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783"},
+    {"Password", "NaCl", 80000,
+     "4ddcd8f60b98be21830cee5ef22701f9641a4418d04c0414aeff08876b34ab56"
+     "a1d425a1225833549adb841b51c9b3176a272bdebba1d078478f62b397f33c8d"},
+};
+
+static string hex(const vector<u8>& data)
+{
+    static const char digits[] = "0123456789abcdef";
+    string out;
+    for (u8 b : data) {
+        out += digits[b >> 4];
+        out += digits[b & 0xf];
+    }
+    return out;
+}
+
+static vector<u8> derive(const Vector& v)
+{
+    vector<u8> key(v.key_hex.size() / 2);
+    fastpbkdf2_hmac_sha256((const u8*) v.password.data(), v.password.size(), (const u8*) v.salt.data(),
+                           v.salt.size(), v.iterations, key.data(), key.size());
+    return key;
+}
+
+/// Restores every CPU feature after a test hid some
+struct ShowFeatures {
+    ~ShowFeatures() { fastpbkdf2_sha256_hide_features(0); }
+};
+
+BOOST_AUTO_TEST_CASE(single_matches_known_answers)
+{
+    BOOST_TEST_MESSAGE("implementation: " << (int) fastpbkdf2_sha256_select(1));
+    for (const Vector& v : VECTORS)
+        BOOST_TEST(hex(derive(v)) == v.key_hex);
+}
+
+BOOST_AUTO_TEST_CASE(falls_back_to_openssl_without_sha_ni)
+{
+    ShowFeatures show;
+    fastpbkdf2_sha256_hide_features(FASTPBKDF2_SHA_NI | FASTPBKDF2_AVX2);
+    BOOST_TEST(fastpbkdf2_sha256_select(1) == FASTPBKDF2_SHA256_OPENSSL);
+    BOOST_TEST(fastpbkdf2_sha256_select(100) == FASTPBKDF2_SHA256_OPENSSL);
+    for (const Vector& v : VECTORS)
+        BOOST_TEST(hex(derive(v)) == v.key_hex);
+
+    // A single derivation takes the same fallback when only the SHA extensions are missing
+    fastpbkdf2_sha256_hide_features(FASTPBKDF2_SHA_NI);
+    BOOST_TEST(fastpbkdf2_sha256_select(1) == FASTPBKDF2_SHA256_OPENSSL);
+    BOOST_TEST(hex(derive(VECTORS[3])) == VECTORS[3].key_hex);
+}
+
+BOOST_AUTO_TEST_CASE(agrees_with_openssl_on_long_keys)
+{
+    // Output lengths around the 32-byte block, so the last block is partial, whole or one of several
+    const string password = "a password longer than the sixty-four byte SHA-256 block, hashed first";
+    const string salt = "salt";
+    for (size_t len : {1, 31, 32, 33, 64, 100, 130}) {
+        vector<u8> key(len), expected(len);
+        fastpbkdf2_hmac_sha256((const u8*) password.data(), password.size(), (const u8*) salt.data(),
+                               salt.size(), 1000, key.data(), key.size());
+        PKCS5_PBKDF2_HMAC(password.data(), password.size(), (const u8*) salt.data(), salt.size(), 1000,
+                          EVP_sha256(), expected.size(), expected.data());
+        BOOST_TEST(hex(key) == hex(expected));
+    }
+}
+
+/// Lane jobs the multi-input tests run: fewer than X8_MIN_JOBS, around NI_LANES and X8_LANES, and above
+static const vector<size_t> INPUT_COUNTS = {1, 2, 3, 4, 5, 8, 9, 17};
+
+/**
+ * Derive keys for count mixed inputs at once and check each against the single-input function and OpenSSL
+ * Passwords are empty, short and longer than the SHA-256 block, salts of varying length
+ * @param count: inputs
+ * @param nout: key length, 16 and 32 make one job per input, 80 makes three
+ */
+static void check_multi(size_t count, size_t nout)
+{
+    vector<string> passwords, salts;
+    for (size_t i = 0; i < count; i++) {
+        passwords.push_back(string(i * 11 % 90, (char) ('a' + i)));
+        salts.push_back("salt" + string(i % 7, (char) ('0' + i)));
+    }
+
+    vector<const u8*> pw, salt;
+    vector<size_t> npw, nsalt;
+    vector<vector<u8>> keys(count, vector<u8>(nout));
+    vector<u8*> out;
+    for (size_t i = 0; i < count; i++) {
+        pw.push_back((const u8*) passwords[i].data());
+        npw.push_back(passwords[i].size());
+        salt.push_back((const u8*) salts[i].data());
+        nsalt.push_back(salts[i].size());
+        out.push_back(keys[i].data());
+    }
+    fastpbkdf2_hmac_sha256_multi(pw.data(), npw.data(), salt.data(), nsalt.data(), 3, out.data(), nout,
+                                 count);
+
+    for (size_t i = 0; i < count; i++) {
+        vector<u8> single(nout), openssl(nout);
+        fastpbkdf2_hmac_sha256(pw[i], npw[i], salt[i], nsalt[i], 3, single.data(), nout);
+        PKCS5_PBKDF2_HMAC(passwords[i].data(), npw[i], salt[i], nsalt[i], 3, EVP_sha256(), nout,
+                          openssl.data());
+        BOOST_TEST(hex(keys[i]) == hex(single), "input " << i << " of " << count << ", " << nout << " bytes");
+        BOOST_TEST(hex(single) == hex(openssl));
+    }
+}
+
+/// Multi-input derivations of the known-answer vectors, all in one call
+static void check_multi_known_answers()
+{
+    vector<const u8*> pw, salt;
+    vector<size_t> npw, nsalt;
+    vector<vector<u8>> keys;
+    vector<u8*> out;
+    // One call takes one key length and iteration count: the 4096-iteration vectors, cut to 16 bytes
+    vector<Vector> group;
+    for (const Vector& v : VECTORS)
+        if (v.iterations == 4096)
+            group.push_back(v);
+    keys.assign(group.size(), vector<u8>(16));
+    for (size_t i = 0; i < group.size(); i++) {
+        pw.push_back((const u8*) group[i].password.data());
+        npw.push_back(group[i].password.size());
+        salt.push_back((const u8*) group[i].salt.data());
+        nsalt.push_back(group[i].salt.size());
+        out.push_back(keys[i].data());
+    }
+    fastpbkdf2_hmac_sha256_multi(pw.data(), npw.data(), salt.data(), nsalt.data(), 4096, out.data(), 16,
+                                 group.size());
+    for (size_t i = 0; i < group.size(); i++)
+        BOOST_TEST(hex(keys[i]) == group[i].key_hex.substr(0, 32));
+}
+
+static void check_multi_everywhere()
+{
+    check_multi_known_answers();
+    for (size_t count : INPUT_COUNTS)
+        for (size_t nout : {16, 32, 80})
+            check_multi(count, nout);
+}
+
+BOOST_AUTO_TEST_CASE(multi_matches_single)
+{
+    check_multi_everywhere();
+}
+
+BOOST_AUTO_TEST_CASE(multi_on_avx2_lanes)
+{
+    ShowFeatures show;
+    fastpbkdf2_sha256_hide_features(FASTPBKDF2_SHA_NI);
+    if (fastpbkdf2_sha256_select(8) != FASTPBKDF2_SHA256_AVX2_X8) {
+        BOOST_TEST_MESSAGE("no AVX2, the eight-lane path is not tested on this host");
+        return;
+    }
+    // Fewer jobs than X8_MIN_JOBS stay on OpenSSL, more fill the lanes partly or wholly
+    BOOST_TEST(fastpbkdf2_sha256_select(2) == FASTPBKDF2_SHA256_OPENSSL);
+    BOOST_TEST(fastpbkdf2_sha256_select(3) == FASTPBKDF2_SHA256_AVX2_X8);
+    check_multi_everywhere();
+}
+
+BOOST_AUTO_TEST_CASE(multi_on_openssl)
+{
+    ShowFeatures show;
+    fastpbkdf2_sha256_hide_features(FASTPBKDF2_SHA_NI | FASTPBKDF2_AVX2);
+    check_multi_everywhere();
+}